@@ -0,0 +1,640 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <future>
+#include <new>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "binary_stream.h"
+#include "goods.h"
+#include "goods_type_enum.h"
+#include "object.h"
+#include "package.h"
+#include "package_journal.h"
+#include "package_service.h"
+#include "package_snapshot.h"
+#include "util.h"
+
+//////////////////////////////////////////////////////////////////////////
+// 背包引擎基准测试（make bench）
+//
+// 每个用例按样本计时：一个样本内连续执行 batch 次操作，样本耗时 / batch 作为一次 ns/op，
+// p50/p99 取自样本分布；事务的打开/回滚、背包状态的恢复都不计时。
+// 参数：过滤串（只跑名字包含该串的用例），例如 ./output/bench put
+//////////////////////////////////////////////////////////////////////////
+
+// 全局堆分配计数
+static std::atomic<uint64_t> g_alloc_count{ 0 };
+
+void* operator new(size_t size) {
+    g_alloc_count.fetch_add(1, std::memory_order_relaxed);
+    if (void* ptr = std::malloc(size ? size : 1))
+        return ptr;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+    std::free(ptr);
+}
+
+void* operator new(size_t size, std::align_val_t align) {
+    g_alloc_count.fetch_add(1, std::memory_order_relaxed);
+    const auto alignment = std::max(static_cast<size_t>(align), sizeof(void*));
+    if (void* ptr = std::aligned_alloc(alignment, (std::max<size_t>(size, 1) + alignment - 1) / alignment * alignment))
+        return ptr;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* ptr, std::align_val_t) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, size_t, std::align_val_t) noexcept {
+    std::free(ptr);
+}
+
+namespace {
+
+    using bench_clock = std::chrono::steady_clock;
+
+    constexpr uint32_t item_kinds = 20;         // 可叠加物品种类（id 1 ~ 20）
+    constexpr uint32_t item_overlap = 99;
+    constexpr uint32_t equip_id = 100;          // 不可叠加的装备
+    constexpr uint32_t batch = 16;              // 单步操作每个样本的次数
+    constexpr uint32_t capacity_spare = 64;     // 最大容量比当前容量多出的格子（aug 用）
+
+    constexpr uint32_t sample_min = 20;
+    constexpr uint32_t sample_max = 5000;
+    constexpr uint32_t sample_warmup = 3;
+    constexpr auto case_budget = std::chrono::milliseconds(30);
+
+    /// <summary>
+    /// 样本计时（start/stop 之间为计时区域）
+    /// </summary>
+    class bench_timer {
+    private:
+        bench_clock::time_point _begin;
+        uint64_t _alloc_begin = 0;
+
+    public:
+        std::vector<double> _samples;       // ns/op
+        uint64_t _ops = 0;                  // 计时区域内的操作数
+        uint64_t _allocs = 0;               // 计时区域内的堆分配次数
+        bool _record = true;                // 预热时不记录
+
+        void start() {
+            _alloc_begin = g_alloc_count.load(std::memory_order_relaxed);
+            _begin = bench_clock::now();
+        }
+
+        void stop(uint32_t ops) {
+            const auto end = bench_clock::now();
+            const uint64_t allocs = g_alloc_count.load(std::memory_order_relaxed) - _alloc_begin;
+            if (!_record || ops == 0)
+                return;
+            _samples.emplace_back(std::chrono::duration<double, std::nano>(end - _begin).count() / ops);
+            _ops += ops;
+            _allocs += allocs;
+        }
+    };
+
+    enum class fill_pattern {
+        empty,          // 空背包
+        half,           // 隔一格放一堆未满的物品
+        full,           // 全部放满（3/4 满堆物品，1/4 装备）
+        fragmented,     // 随机 60% 的格子，随机物品随机数量，夹杂装备
+    };
+
+    const char* fill_name(fill_pattern fill) {
+        switch (fill) {
+        case fill_pattern::empty:       return "empty";
+        case fill_pattern::half:        return "half";
+        case fill_pattern::full:        return "full";
+        case fill_pattern::fragmented:  return "fragmented";
+        }
+        return "?";
+    }
+
+    struct bench_goods {
+        std::vector<goods_ptr> _items;      // 下标 = id - 1
+        std::vector<goods_ptr> _equips;     // 预先创建的装备
+        uint64_t _uuid = 1;
+
+        bench_goods() {
+            for (uint32_t id = 1; id <= item_kinds; ++id) {
+                _items.emplace_back(goods::create(0, id, goods_type_enum::item, item_overlap));
+            }
+            for (uint32_t i = 0; i < batch; ++i) {
+                _equips.emplace_back(equip());
+            }
+        }
+
+        goods_ptr equip() {
+            return goods::create(_uuid++, equip_id, goods_type_enum::equip, 1);
+        }
+    };
+
+    void fill(package& bag, fill_pattern pattern, bench_goods& goods, std::mt19937& rng) {
+        const uint32_t capacity = bag.capacity_cur();
+        package_operator op(&bag);
+        for (slot_id slot = 0; slot < capacity; ++slot) {
+            switch (pattern) {
+            case fill_pattern::empty:
+                break;
+            case fill_pattern::half:
+                if (slot % 2 == 0)
+                    op.put(goods._items[(slot / 2) % item_kinds], item_overlap / 2, slot, false);
+                break;
+            case fill_pattern::full:
+                if (slot % 4 == 3)
+                    op.put(goods.equip(), 1, slot, false);
+                else
+                    op.put(goods._items[slot % item_kinds], item_overlap, slot, false);
+                break;
+            case fill_pattern::fragmented:
+                if (rng() % 10 < 6) {
+                    if (rng() % 10 == 0)
+                        op.put(goods.equip(), 1, slot, false);
+                    else
+                        op.put(goods._items[rng() % item_kinds], 1 + rng() % item_overlap, slot, false);
+                }
+                break;
+            }
+        }
+        op.commit().release();
+    }
+
+    /// <summary>
+    /// 一个容量 + 填充方式下的用例环境
+    /// </summary>
+    struct bench_env {
+        package _bag;
+        bench_goods& _goods;
+        std::mt19937 _rng{ 20230101 };
+        std::string _snapshot;          // 填充后的快照（恢复状态用）
+
+        bench_env(uint32_t capacity, fill_pattern pattern, bench_goods& goods)
+            : _bag(nullptr, package_type_enum::store, capacity + capacity_spare)
+            , _goods(goods) {
+            _bag.capacity_cur(capacity);
+            fill(_bag, pattern, _goods, _rng);
+
+            binary_writer writer;
+            package_snapshot::save(&_bag, writer);
+            _snapshot = writer.buffer();
+        }
+
+        void restore() {
+            package_snapshot::load(_snapshot, &_bag);
+        }
+
+        slot_id random_slot() {
+            return static_cast<slot_id>(_rng() % _bag.capacity_cur());
+        }
+    };
+
+    using bench_fn = std::function<void(bench_env&, bench_timer&)>;
+
+    struct bench_case {
+        const char* _name;
+        bench_fn _fn;
+    };
+
+    const std::vector<bench_case>& package_cases() {
+        static const std::vector<bench_case> cases = {
+            { "put", [](bench_env& env, bench_timer& timer) {
+                package_operator op(&env._bag);
+                timer.start();
+                for (uint32_t i = 0; i < batch; ++i) {
+                    op.put(env._goods._items[i % item_kinds], 1);
+                }
+                timer.stop(batch);
+                op.rollback().release();
+            } },
+            { "put_many", [](bench_env& env, bench_timer& timer) {
+                // 与 put 相同的 batch 项，一次批量添加（对比逐个 put）
+                static thread_local std::vector<put_entry> entries;
+                entries.clear();
+                for (uint32_t i = 0; i < batch; ++i) {
+                    entries.push_back(put_entry{ env._goods._items[i % item_kinds], 1 });
+                }
+                package_operator op(&env._bag);
+                timer.start();
+                op.put_many(entries);
+                timer.stop(batch);
+                op.rollback().release();
+            } },
+            { "put_equip", [](bench_env& env, bench_timer& timer) {
+                package_operator op(&env._bag);
+                timer.start();
+                for (uint32_t i = 0; i < batch; ++i) {
+                    op.put(env._goods._equips[i], 1);
+                }
+                timer.stop(batch);
+                op.rollback().release();
+            } },
+            { "rem", [](bench_env& env, bench_timer& timer) {
+                package_operator op(&env._bag);
+                timer.start();
+                for (uint32_t i = 0; i < batch; ++i) {
+                    op.rem(1 + i % item_kinds, 1);
+                }
+                timer.stop(batch);
+                op.rollback().release();
+            } },
+            { "swp", [](bench_env& env, bench_timer& timer) {
+                slot_id slots[batch * 2];
+                for (auto& slot : slots) {
+                    slot = env.random_slot();
+                }
+                package_operator op(&env._bag);
+                timer.start();
+                for (uint32_t i = 0; i < batch; ++i) {
+                    op.swp(slots[i * 2], slots[i * 2 + 1]);
+                }
+                timer.stop(batch);
+                op.rollback().release();
+            } },
+            { "aug", [](bench_env& env, bench_timer& timer) {
+                package_operator op(&env._bag);
+                timer.start();
+                for (uint32_t i = 0; i < batch; ++i) {
+                    op.aug(1);
+                }
+                timer.stop(batch);
+                op.rollback().release();
+            } },
+            { "auto_pack", [](bench_env& env, bench_timer& timer) {
+                timer.start();
+                env._bag.auto_pack();
+                timer.stop(1);
+                env.restore();
+            } },
+            { "commit", [](bench_env& env, bench_timer& timer) {
+                package_operator op(&env._bag);
+                for (uint32_t i = 0; i < batch; ++i) {
+                    op.put(env._goods._items[i % item_kinds], 1);
+                    op.rem(1 + (i + 7) % item_kinds, 1);
+                }
+                timer.start();
+                op.commit();
+                timer.stop(1);
+                op.release();
+                env.restore();
+            } },
+            { "rollback", [](bench_env& env, bench_timer& timer) {
+                package_operator op(&env._bag);
+                for (uint32_t i = 0; i < batch; ++i) {
+                    op.put(env._goods._items[i % item_kinds], 1);
+                    op.rem(1 + (i + 7) % item_kinds, 1);
+                }
+                timer.start();
+                op.rollback();
+                timer.stop(1);
+                op.release();
+            } },
+            { "re_init", [](bench_env& env, bench_timer& timer) {
+                timer.start();
+                env._bag.re_init();
+                timer.stop(1);
+            } },
+        };
+        return cases;
+    }
+
+    double percentile(std::vector<double>& samples, double p) {
+        if (samples.empty())
+            return 0;
+        const size_t index = std::min(samples.size() - 1, static_cast<size_t>(p * samples.size()));
+        std::nth_element(samples.begin(), samples.begin() + index, samples.end());
+        return samples[index];
+    }
+
+    void report(const char* name, const std::string& config, bench_timer& timer) {
+        double total = 0;
+        for (auto sample : timer._samples) {
+            total += sample;
+        }
+        const size_t count = timer._samples.size();
+        const double mean = count ? total / count : 0;
+        const double p50 = percentile(timer._samples, 0.50);
+        const double p99 = percentile(timer._samples, 0.99);
+        const double allocs = timer._ops ? static_cast<double>(timer._allocs) / timer._ops : 0;
+        std::printf("%-12s %-22s %12.1f %12.1f %12.1f %10.2f %8zu\n",
+            name, config.c_str(), mean, p50, p99, allocs, count);
+    }
+
+    /// <summary>
+    /// 按时间预算重复执行样本
+    /// </summary>
+    template<typename _Fn>
+    void run_samples(bench_timer& timer, _Fn&& sample) {
+        timer._record = false;
+        for (uint32_t i = 0; i < sample_warmup; ++i) {
+            sample();
+        }
+        timer._record = true;
+
+        const auto deadline = bench_clock::now() + case_budget;
+        for (uint32_t i = 0; i < sample_max; ++i) {
+            sample();
+            if (i + 1 >= sample_min && bench_clock::now() >= deadline)
+                break;
+        }
+    }
+
+    bool selected(const char* filter, const char* name) {
+        return filter == nullptr || std::strstr(name, filter) != nullptr;
+    }
+
+    void bench_package(const char* filter, bench_goods& goods) {
+        static const uint32_t capacities[] = { 10, 100, 1000, 10000 };
+        static const fill_pattern fills[] = {
+            fill_pattern::empty, fill_pattern::half, fill_pattern::full, fill_pattern::fragmented };
+
+        for (const auto& one : package_cases()) {
+            if (!selected(filter, one._name))
+                continue;
+
+            for (auto capacity : capacities) {
+                for (auto pattern : fills) {
+                    bench_env env(capacity, pattern, goods);
+                    bench_timer timer;
+                    run_samples(timer, [&]() { one._fn(env, timer); });
+                    report(one._name, std::to_string(capacity) + "/" + fill_name(pattern), timer);
+                }
+            }
+        }
+    }
+
+    /// <summary>
+    /// 分片服务：往返延迟（post + 等待结果）和流水线吞吐（一次投递 256 条命令）
+    /// </summary>
+    void bench_service(const char* filter, bench_goods& goods) {
+        static const uint32_t shard_counts[] = { 1, 4 };
+        constexpr uint64_t object_count = 64;
+        constexpr uint32_t pipeline = 256;
+
+        const bool latency = selected(filter, "service_rtt");
+        const bool throughput = selected(filter, "service_pipe");
+        if (!latency && !throughput)
+            return;
+
+        auto item = goods._items[0];
+        auto command = [item](object* pObject) {
+            package_operator op(pObject->store_package());
+            op.put(item, 1);
+            op.rem(item->id(), 1);
+            op.commit().release();
+        };
+
+        for (auto shards : shard_counts) {
+            package_service service(shards);
+            for (uint64_t uuid = 1; uuid <= object_count; ++uuid) {
+                service.add_object(uuid).get();
+            }
+
+            const std::string config = std::to_string(shards) + " shards";
+            if (latency) {
+                bench_timer timer;
+                uint64_t uuid = 0;
+                run_samples(timer, [&]() {
+                    timer.start();
+                    service.post(1 + uuid++ % object_count, command).get();
+                    timer.stop(1);
+                });
+                report("service_rtt", config, timer);
+            }
+            if (throughput) {
+                bench_timer timer;
+                std::atomic<uint32_t> done{ 0 };
+                run_samples(timer, [&]() {
+                    done.store(0, std::memory_order_relaxed);
+                    timer.start();
+                    for (uint32_t i = 0; i < pipeline; ++i) {
+                        service.post(1 + i % object_count, [command](object* pObject) { command(pObject); return 0; },
+                            [&done](int) { done.fetch_add(1, std::memory_order_release); });
+                    }
+                    while (done.load(std::memory_order_acquire) < pipeline) {
+                        std::this_thread::yield();
+                    }
+                    timer.stop(pipeline);
+                });
+                report("service_pipe", config, timer);
+            }
+        }
+    }
+
+    /// <summary>
+    /// 分片服务扩展性：100k 个对象，4 个生产线程投递 put+rem+commit 回调命令，分片数 1 ~ 32
+    /// 样本为每条命令从投递到回调的延迟（生产快于消费时包含排队时间），配置列附带总吞吐
+    /// </summary>
+    void bench_service_scale(const char* filter, bench_goods& goods) {
+        static const uint32_t shard_counts[] = { 1, 2, 4, 8, 16, 32 };
+        constexpr uint64_t object_count = 100000;
+        constexpr uint32_t producer_count = 4;
+        constexpr uint32_t producer_commands = 50000;
+        constexpr uint64_t total = static_cast<uint64_t>(producer_count) * producer_commands;
+
+        if (!selected(filter, "service_scale"))
+            return;
+
+        auto item = goods._items[0];
+        for (auto shards : shard_counts) {
+            package_service service(shards);
+            {
+                std::vector<std::future<bool>> added;
+                added.reserve(object_count);
+                for (uint64_t uuid = 1; uuid <= object_count; ++uuid) {
+                    added.emplace_back(service.add_object(uuid));
+                }
+                for (auto& one : added) {
+                    one.get();
+                }
+            }
+
+            // 每个分片只在自己的线程上写自己的延迟数组
+            std::vector<std::vector<double>> latencies(shards);
+            for (auto& one : latencies) {
+                one.reserve(total / shards * 2);
+            }
+            std::atomic<uint64_t> done{ 0 };
+
+            const uint64_t alloc_begin = g_alloc_count.load(std::memory_order_relaxed);
+            const auto begin = bench_clock::now();
+            std::vector<std::thread> producers;
+            for (uint32_t producer = 0; producer < producer_count; ++producer) {
+                producers.emplace_back([&, producer]() {
+                    std::mt19937_64 rng(producer);
+                    for (uint32_t i = 0; i < producer_commands; ++i) {
+                        const uint64_t uuid = 1 + rng() % object_count;
+                        auto* latency = &latencies[service.shard_of(uuid)];
+                        const auto posted = bench_clock::now();
+                        service.post(uuid,
+                            [item](object* pObject) {
+                                package_operator op(pObject->store_package());
+                                op.put(item, 1);
+                                op.rem(item->id(), 1);
+                                op.commit().release();
+                                return 0;
+                            },
+                            [latency, posted, &done](int) {
+                                latency->emplace_back(std::chrono::duration<double, std::nano>(bench_clock::now() - posted).count());
+                                done.fetch_add(1, std::memory_order_release);
+                            });
+                    }
+                });
+            }
+            for (auto& one : producers) {
+                one.join();
+            }
+            while (done.load(std::memory_order_acquire) < total) {
+                std::this_thread::yield();
+            }
+            const double seconds = std::chrono::duration<double>(bench_clock::now() - begin).count();
+
+            bench_timer timer;
+            for (const auto& one : latencies) {
+                timer._samples.insert(timer._samples.end(), one.begin(), one.end());
+            }
+            timer._ops = total;
+            timer._allocs = g_alloc_count.load(std::memory_order_relaxed) - alloc_begin;
+
+            char config[64];
+            std::snprintf(config, sizeof(config), "%u shards %.2fM/s", shards, total / seconds / 1e6);
+            report("service_scale", config, timer);
+        }
+    }
+
+    /// <summary>
+    /// 提交日志：每个样本一次 put+rem+commit（含日志编码和写入），
+    /// 同步落盘（每次提交 fsync）对比组提交（后台线程按间隔合并 fsync），配置列附带每次 fsync 合并的记录数
+    /// </summary>
+    void bench_journal(const char* filter, bench_goods& goods) {
+        static const uint32_t intervals[] = { 0, 5 };
+        static const char* path = "bench_journal.log";
+
+        if (!selected(filter, "journal"))
+            return;
+
+        auto item = goods._items[0];
+        for (auto interval : intervals) {
+            std::remove(path);
+            package bag(nullptr, package_type_enum::store, 100);
+            bag.capacity_cur(100);
+            package_journal journal;
+            if (!journal.open(path, interval)) {
+                std::printf("journal: open %s failed\n", path);
+                return;
+            }
+            bag.journal(&journal);
+
+            bench_timer timer;
+            run_samples(timer, [&]() {
+                package_operator op(&bag);
+                op.put(item, 1);
+                op.rem(item->id(), 1);
+                timer.start();
+                op.commit();
+                timer.stop(1);
+                op.release();
+            });
+            journal.flush();
+            if (journal.failed())
+                std::printf("journal: write failed\n");
+
+            char config[64];
+            std::snprintf(config, sizeof(config), "%s %.0f rec/sync", interval == 0 ? "sync" : "group 5ms",
+                journal.sync_count() ? static_cast<double>(journal.append_count()) / journal.sync_count() : 0.0);
+            report("journal", config, timer);
+
+            bag.journal(nullptr);
+            journal.close();
+        }
+        std::remove(path);
+    }
+
+    /// <summary>
+    /// 全局ID生成的多线程竞争：每个线程连续取 ID，每 batch * 64 次一个样本；
+    /// id_atomic 为所有线程直接 fetch_add 同一个计数的对照
+    /// </summary>
+    void bench_id_generator(const char* filter) {
+        static const uint32_t thread_counts[] = { 1, 2, 4 };
+        constexpr uint32_t sample_ops = batch * 64;
+        constexpr uint32_t thread_samples = 500;
+
+        const bool generator = selected(filter, "id_next");
+        const bool atomic = selected(filter, "id_atomic");
+        if (!generator && !atomic)
+            return;
+
+        std::atomic<uint64_t> shared{ 0 };
+        auto run = [&](const char* name, uint32_t threads, uint64_t (*next)(std::atomic<uint64_t>&)) {
+            std::vector<bench_timer> timers(threads);
+            std::vector<std::thread> workers;
+            std::atomic<uint64_t> sink{ 0 };
+            for (uint32_t t = 0; t < threads; ++t) {
+                workers.emplace_back([&, t]() {
+                    auto& timer = timers[t];
+                    uint64_t value = 0;
+                    for (uint32_t i = 0; i < thread_samples; ++i) {
+                        timer.start();
+                        for (uint32_t j = 0; j < sample_ops; ++j) {
+                            value ^= next(shared);
+                        }
+                        timer.stop(sample_ops);
+                    }
+                    sink.fetch_xor(value, std::memory_order_relaxed);
+                });
+            }
+            for (auto& one : workers) {
+                one.join();
+            }
+
+            bench_timer timer;
+            for (const auto& one : timers) {
+                timer._samples.insert(timer._samples.end(), one._samples.begin(), one._samples.end());
+                timer._ops += one._ops;
+            }
+            report(name, std::to_string(threads) + " threads", timer);
+        };
+
+        for (auto threads : thread_counts) {
+            if (generator)
+                run("id_next", threads, [](std::atomic<uint64_t>&) { return util::id_generator::next(); });
+            if (atomic)
+                run("id_atomic", threads, [](std::atomic<uint64_t>& value) { return value.fetch_add(1, std::memory_order_relaxed); });
+        }
+    }
+
+} // end namespace
+
+int main(int argc, char* argv[]) {
+    const char* filter = argc > 1 ? argv[1] : nullptr;
+
+    std::printf("%-12s %-22s %12s %12s %12s %10s %8s\n",
+        "op", "capacity/fill", "mean ns/op", "p50 ns/op", "p99 ns/op", "allocs/op", "samples");
+
+    bench_goods goods;
+    for (const auto& one : goods._items) {
+        goods_registry::instance().intern(one);
+    }
+    goods_registry::instance().freeze();
+    bench_package(filter, goods);
+    bench_service(filter, goods);
+    bench_service_scale(filter, goods);
+    bench_journal(filter, goods);
+    bench_id_generator(filter);
+    return 0;
+}
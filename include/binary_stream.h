@@ -0,0 +1,128 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+/// <summary>
+/// 二进制写入（小端定长 + varint）
+/// </summary>
+class binary_writer {
+private:
+    std::string _buffer;
+
+public:
+    binary_writer() = default;
+
+    explicit binary_writer(size_t reserve) {
+        _buffer.reserve(reserve);
+    }
+
+    const std::string& buffer() const { return _buffer; }
+    std::string& buffer() { return _buffer; }
+    size_t size() const { return _buffer.size(); }
+    void clear() { _buffer.clear(); }
+
+    void write_u8(uint8_t value) {
+        _buffer.push_back(static_cast<char>(value));
+    }
+
+    void write_u32(uint32_t value) {
+        for (int i = 0; i < 4; ++i) {
+            write_u8(static_cast<uint8_t>(value >> (i * 8)));
+        }
+    }
+
+    void write_u64(uint64_t value) {
+        for (int i = 0; i < 8; ++i) {
+            write_u8(static_cast<uint8_t>(value >> (i * 8)));
+        }
+    }
+
+    void write_varint(uint64_t value) {
+        while (value >= 0x80) {
+            write_u8(static_cast<uint8_t>(value | 0x80));
+            value >>= 7;
+        }
+        write_u8(static_cast<uint8_t>(value));
+    }
+
+    void write_bytes(const void* data, size_t size) {
+        _buffer.append(static_cast<const char*>(data), size);
+    }
+};
+
+/// <summary>
+/// 二进制读取（不拷贝数据，可直接读内存映射的缓冲区）
+/// 读取失败后 ok() 为 false，后续读取都失败
+/// </summary>
+class binary_reader {
+private:
+    const uint8_t* _data = nullptr;
+    size_t _size = 0;
+    size_t _pos = 0;
+    bool _ok = true;
+
+public:
+    binary_reader(const void* data, size_t size)
+        : _data(static_cast<const uint8_t*>(data))
+        , _size(size) {
+    }
+
+    explicit binary_reader(const std::string& buffer)
+        : binary_reader(buffer.data(), buffer.size()) {
+    }
+
+    bool ok() const { return _ok; }
+    size_t pos() const { return _pos; }
+    size_t remain() const { return _size - _pos; }
+    bool eof() const { return _pos >= _size; }
+
+    bool read_u8(uint8_t& value) {
+        if (!_ok || _pos + 1 > _size) return _ok = false;
+        value = _data[_pos++];
+        return true;
+    }
+
+    bool read_u32(uint32_t& value) {
+        if (!_ok || _pos + 4 > _size) return _ok = false;
+        value = 0;
+        for (int i = 0; i < 4; ++i) {
+            value |= static_cast<uint32_t>(_data[_pos++]) << (i * 8);
+        }
+        return true;
+    }
+
+    bool read_u64(uint64_t& value) {
+        if (!_ok || _pos + 8 > _size) return _ok = false;
+        value = 0;
+        for (int i = 0; i < 8; ++i) {
+            value |= static_cast<uint64_t>(_data[_pos++]) << (i * 8);
+        }
+        return true;
+    }
+
+    bool read_varint(uint64_t& value) {
+        value = 0;
+        for (uint32_t shift = 0; shift < 64; shift += 7) {
+            uint8_t byte = 0;
+            if (!read_u8(byte)) return false;
+            value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+            if ((byte & 0x80) == 0) return true;
+        }
+        return _ok = false;
+    }
+
+    bool read_varint(uint32_t& value) {
+        uint64_t wide = 0;
+        if (!read_varint(wide) || wide > UINT32_MAX) return _ok = false;
+        value = static_cast<uint32_t>(wide);
+        return true;
+    }
+
+    bool read_bytes(void* data, size_t size) {
+        if (!_ok || _pos + size > _size) return _ok = false;
+        std::memcpy(data, _data + _pos, size);
+        _pos += size;
+        return true;
+    }
+};
@@ -0,0 +1,200 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/// <summary>
+/// 整数 key 的散列（斐波那契乘法，低位分布均匀，适合 2 的幂容量）
+/// </summary>
+template<typename _Kty, typename = void>
+struct flat_hash {
+    size_t operator()(const _Kty& key) const {
+        return std::hash<_Kty>()(key);
+    }
+};
+
+template<typename _Kty>
+struct flat_hash<_Kty, typename std::enable_if<std::is_integral<_Kty>::value>::type> {
+    size_t operator()(const _Kty& key) const {
+        const uint64_t hash = static_cast<uint64_t>(key) * 0x9E3779B97F4A7C15ull;
+        return static_cast<size_t>(hash ^ (hash >> 32));
+    }
+};
+
+/// <summary>
+/// 开放寻址（线性探测）散列表
+/// 数据连续存放，删除时后移回填，不留墓碑；插入/删除会使迭代器失效
+/// </summary>
+template<typename _Kty, typename _Ty, typename _Hasher = flat_hash<_Kty>>
+class flat_hash_map final {
+public:
+    using key_type = _Kty;
+    using mapped_type = _Ty;
+    using value_type = std::pair<_Kty, _Ty>;
+
+private:
+    std::vector<value_type> _slots;     // 数据
+    std::vector<uint8_t> _used;         // 是否占用
+    size_t _size = 0;                   // 数量
+    size_t _mask = 0;                   // 容量 - 1
+
+    template<typename _Map, typename _Value>
+    class basic_iterator {
+        friend class flat_hash_map;
+        _Map* _map = nullptr;
+        size_t _index = 0;
+
+        void skip() {
+            while (_index < _map->_slots.size() && !_map->_used[_index])
+                ++_index;
+        }
+    public:
+        basic_iterator() = default;
+        basic_iterator(_Map* map, size_t index) : _map(map), _index(index) {
+            skip();
+        }
+        template<typename _OMap, typename _OValue>
+        basic_iterator(const basic_iterator<_OMap, _OValue>& src) : _map(src._map), _index(src._index) {
+        }
+
+        _Value& operator*() const { return _map->_slots[_index]; }
+        _Value* operator->() const { return &_map->_slots[_index]; }
+
+        basic_iterator& operator++() {
+            ++_index;
+            skip();
+            return *this;
+        }
+
+        bool operator == (const basic_iterator& rhs) const { return _index == rhs._index; }
+        bool operator != (const basic_iterator& rhs) const { return _index != rhs._index; }
+
+        template<typename, typename> friend class basic_iterator;
+    };
+
+public:
+    using iterator = basic_iterator<flat_hash_map, value_type>;
+    using const_iterator = basic_iterator<const flat_hash_map, const value_type>;
+
+    flat_hash_map() = default;
+
+    size_t size() const { return _size; }
+    bool empty() const { return _size == 0; }
+    size_t capacity() const { return _slots.size(); }
+
+    iterator begin() { return iterator(this, 0); }
+    iterator end() { return iterator(this, _slots.size()); }
+    const_iterator begin() const { return const_iterator(this, 0); }
+    const_iterator end() const { return const_iterator(this, _slots.size()); }
+
+    void clear() {
+        for (size_t i = 0; i < _slots.size(); ++i) {
+            if (_used[i]) {
+                _slots[i] = value_type();
+                _used[i] = 0;
+            }
+        }
+        _size = 0;
+    }
+
+    void reserve(size_t count) {
+        size_t capacity = _slots.empty() ? 8 : _slots.size();
+        while (count * 8 > capacity * 7)
+            capacity *= 2;
+        if (capacity != _slots.size())
+            rehash(capacity);
+    }
+
+    iterator find(const _Kty& key) {
+        return iterator(this, find_index(key));
+    }
+
+    const_iterator find(const _Kty& key) const {
+        return const_iterator(this, find_index(key));
+    }
+
+    size_t count(const _Kty& key) const {
+        return find_index(key) != _slots.size() ? 1 : 0;
+    }
+
+    template<typename... _Args>
+    std::pair<iterator, bool> emplace(const _Kty& key, _Args&&... args) {
+        const size_t index = find_index(key);
+        if (index != _slots.size())
+            return std::make_pair(iterator(this, index), false);
+
+        reserve(_size + 1);
+        size_t pos = _Hasher()(key) & _mask;
+        while (_used[pos])
+            pos = (pos + 1) & _mask;
+        _slots[pos] = value_type(key, _Ty(std::forward<_Args>(args)...));
+        _used[pos] = 1;
+        ++_size;
+        return std::make_pair(iterator(this, pos), true);
+    }
+
+    _Ty& operator[](const _Kty& key) {
+        return emplace(key).first->second;
+    }
+
+    size_t erase(const _Kty& key) {
+        const size_t index = find_index(key);
+        if (index == _slots.size())
+            return 0;
+        erase_index(index);
+        return 1;
+    }
+
+    void erase(iterator iter) {
+        erase_index(iter._index);
+    }
+
+private:
+    size_t find_index(const _Kty& key) const {
+        if (_size == 0)
+            return _slots.size();
+        size_t pos = _Hasher()(key) & _mask;
+        while (_used[pos]) {
+            if (_slots[pos].first == key)
+                return pos;
+            pos = (pos + 1) & _mask;
+        }
+        return _slots.size();
+    }
+
+    void erase_index(size_t index) {
+        // 后移回填：把探测链上可以前移的元素挪到空位
+        size_t hole = index;
+        size_t next = (hole + 1) & _mask;
+        while (_used[next]) {
+            const size_t home = _Hasher()(_slots[next].first) & _mask;
+            if (((next - home) & _mask) >= ((next - hole) & _mask)) {
+                _slots[hole] = std::move(_slots[next]);
+                hole = next;
+            }
+            next = (next + 1) & _mask;
+        }
+        _slots[hole] = value_type();
+        _used[hole] = 0;
+        --_size;
+    }
+
+    void rehash(size_t capacity) {
+        std::vector<value_type> slots(capacity);
+        std::vector<uint8_t> used(capacity, 0);
+        std::swap(slots, _slots);
+        std::swap(used, _used);
+        _mask = capacity - 1;
+        for (size_t i = 0; i < slots.size(); ++i) {
+            if (!used[i])
+                continue;
+            size_t pos = _Hasher()(slots[i].first) & _mask;
+            while (_used[pos])
+                pos = (pos + 1) & _mask;
+            _slots[pos] = std::move(slots[i]);
+            _used[pos] = 1;
+        }
+    }
+};
@@ -1,17 +1,24 @@
 #pragma once
+#include <atomic>
+#include <cassert>
 #include <cstdint>
 #include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
 
 #include "goods_type_enum.h"
 
 class goods;
 
 class goods : std::enable_shared_from_this<goods> {
+    friend class goods_registry;
 private:
     uint64_t _uuid = 0;           // uuid
     uint32_t _id = 0;             // config id
     goods_type_enum _type;        // type
     uint32_t _overlap_max = 1;    // 最大叠加数量
+    bool _interned = false;       // 是否为注册表中的共享对象
 public:
     goods() = default;
     virtual ~goods() = default;
@@ -37,15 +44,142 @@ public:
         _id = id_;
     }
 
+    goods_type_enum type() const {
+        return _type;
+    }
+
     uint32_t overlap_max() const {
         return _overlap_max;
     }
 
+    /// <summary>
+    /// 是否带实例数据（装备/宠物等，每个格子需要独立对象）
+    /// </summary>
+    bool has_instance_state() const {
+        return _type != goods_type_enum::item;
+    }
+
+    bool interned() const {
+        return _interned;
+    }
+
 public:
     static std::shared_ptr<goods> create(uint64_t uuid_, uint32_t id_, goods_type_enum type_, uint32_t overlap_max_) {
         return std::make_shared<goods>(uuid_, id_, type_, overlap_max_);
     }
-    static std::shared_ptr<goods> create(std::shared_ptr<goods> source) {
+    static std::shared_ptr<goods> create(const std::shared_ptr<const goods>& source) {
         return std::make_shared<goods>(source->_uuid, source->_id, source->_type, source->_overlap_max);
     }
 };
+
+/// <summary>
+/// 道具配置注册表（flyweight）
+/// 不带实例数据的道具按配置ID共享同一个只读 goods 对象，放入格子时不再分配；
+/// 共享对象以 shared_ptr<const goods> 返回，不能通过它调用 id()/uuid() 的设置接口（否则所有背包一起变）
+///
+/// 配置加载时 intern 所有道具后调用 freeze，之后注册表只读，查找不加锁（分片线程不再争用同一把锁）；
+/// freeze 之后遇到未登记的配置ID（例如配置已删除的旧存档）返回不共享的副本
+/// </summary>
+class goods_registry final {
+private:
+    mutable std::shared_mutex _mutex;
+    std::unordered_map<uint32_t, std::shared_ptr<const goods>> _goods;    // 配置id->共享对象
+    std::atomic<bool> _frozen{ false };                                   // 已冻结（只读）
+
+public:
+    static goods_registry& instance() {
+        static goods_registry _instance;
+        return _instance;
+    }
+
+    /// <summary>
+    /// 获取配置ID对应的共享对象（不存在则以 source 的配置创建）
+    /// </summary>
+    /// <param name="source">物品对象</param>
+    /// <returns>共享对象</returns>
+    std::shared_ptr<const goods> intern(const std::shared_ptr<const goods>& source) {
+        return intern(source->id(), source->type(), source->overlap_max());
+    }
+
+    /// <summary>
+    /// 获取配置ID对应的共享对象（不存在则按给定配置创建）
+    /// </summary>
+    /// <param name="id_">配置ID</param>
+    /// <param name="type_">类型</param>
+    /// <param name="overlap_max_">最大叠加数量</param>
+    /// <returns>共享对象</returns>
+    std::shared_ptr<const goods> intern(uint32_t id_, goods_type_enum type_, uint32_t overlap_max_) {
+        if (_frozen.load(std::memory_order_acquire)) {
+            auto iter = _goods.find(id_);
+            if (iter != _goods.end())
+                return checked(iter->second, type_, overlap_max_);
+            return goods::create(0, id_, type_, overlap_max_);
+        }
+        {
+            std::shared_lock<std::shared_mutex> lock(_mutex);
+            auto iter = _goods.find(id_);
+            if (iter != _goods.end())
+                return checked(iter->second, type_, overlap_max_);
+        }
+        std::unique_lock<std::shared_mutex> lock(_mutex);
+        auto iter = _goods.find(id_);
+        if (iter == _goods.end()) {
+            auto result = goods::create(0, id_, type_, overlap_max_);
+            result->_interned = true;
+            iter = _goods.emplace(id_, std::move(result)).first;
+        }
+        return checked(iter->second, type_, overlap_max_);
+    }
+
+    /// <summary>
+    /// 冻结注册表（配置加载完成后、分片线程开始处理命令前调用）
+    /// </summary>
+    void freeze() {
+        _frozen.store(true, std::memory_order_release);
+    }
+
+    bool frozen() const {
+        return _frozen.load(std::memory_order_acquire);
+    }
+
+    /// <summary>
+    /// 放入格子用的对象：带实例数据的复制一份，其余共享注册表对象
+    /// </summary>
+    /// <param name="source">物品对象</param>
+    /// <returns>格子持有的对象</returns>
+    std::shared_ptr<const goods> acquire(const std::shared_ptr<const goods>& source) {
+        if (source->has_instance_state())
+            return goods::create(source);
+        if (source->interned())
+            return source;      // 已是共享对象（从其他格子移动过来），不需要查找
+        return intern(source);
+    }
+
+    std::shared_ptr<const goods> find(uint32_t id) const {
+        std::shared_lock<std::shared_mutex> lock(_mutex, std::defer_lock);
+        if (!frozen())
+            lock.lock();
+        auto iter = _goods.find(id);
+        return iter != _goods.end() ? iter->second : nullptr;
+    }
+
+    /// <summary>
+    /// 清空并解除冻结（只能在没有其他线程使用注册表时调用）
+    /// </summary>
+    void clear() {
+        std::unique_lock<std::shared_mutex> lock(_mutex);
+        _goods.clear();
+        _frozen.store(false, std::memory_order_release);
+    }
+
+private:
+    /// <summary>
+    /// 同一配置ID的类型和叠加数必须一致，否则拿到的共享对象与调用方的配置不符
+    /// </summary>
+    static const std::shared_ptr<const goods>& checked(const std::shared_ptr<const goods>& result, goods_type_enum type_, uint32_t overlap_max_) {
+        assert(result->type() == type_ && result->overlap_max() == overlap_max_);
+        (void)type_;
+        (void)overlap_max_;
+        return result;
+    }
+};
@@ -0,0 +1,72 @@
+#pragma once
+#include <atomic>
+
+/// <summary>
+/// 侵入式队列节点
+/// </summary>
+struct mpsc_node {
+    std::atomic<mpsc_node*> _next{ nullptr };
+};
+
+/// <summary>
+/// 多生产者单消费者无锁队列（侵入式，Vyukov）
+/// push 任意线程调用（一次 exchange + 一次 store，无锁无分配）；pop/empty 只能由唯一的消费者线程调用
+/// 节点的生命周期由使用者管理
+/// </summary>
+class mpsc_queue final {
+private:
+    alignas(64) std::atomic<mpsc_node*> _head;     // 生产者写入端
+    alignas(64) mpsc_node* _tail;                  // 消费者读取端
+    mpsc_node _stub;
+
+public:
+    mpsc_queue() : _head(&_stub), _tail(&_stub) {
+    }
+
+    // !! non copyable 
+    mpsc_queue(const mpsc_queue&) = delete;
+    mpsc_queue& operator = (const mpsc_queue&) = delete;
+
+    void push(mpsc_node* node) {
+        node->_next.store(nullptr, std::memory_order_relaxed);
+        mpsc_node* prev = _head.exchange(node, std::memory_order_acq_rel);
+        prev->_next.store(node, std::memory_order_release);
+    }
+
+    /// <summary>
+    /// 取出一个节点
+    /// </summary>
+    /// <returns>节点，队列为空（或生产者正在写入）时为 nullptr</returns>
+    mpsc_node* pop() {
+        mpsc_node* tail = _tail;
+        mpsc_node* next = tail->_next.load(std::memory_order_acquire);
+        if (tail == &_stub) {
+            if (next == nullptr)
+                return nullptr;
+            _tail = next;
+            tail = next;
+            next = next->_next.load(std::memory_order_acquire);
+        }
+        if (next != nullptr) {
+            _tail = next;
+            return tail;
+        }
+        if (tail != _head.load(std::memory_order_acquire))
+            return nullptr;
+
+        push(&_stub);
+        next = tail->_next.load(std::memory_order_acquire);
+        if (next != nullptr) {
+            _tail = next;
+            return tail;
+        }
+        return nullptr;
+    }
+
+    /// <summary>
+    /// 是否为空（包括生产者已开始但未完成写入的节点，即返回 false 时 pop 可能暂时取不到）
+    /// </summary>
+    bool empty() const {
+        return _tail == &_stub && _head.load(std::memory_order_seq_cst) == &_stub;
+    }
+};
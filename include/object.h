@@ -23,6 +23,10 @@ public:
     }
     virtual ~object() = default;
 
+    uint64_t uuid() const {
+        return _uuid;
+    }
+
     package* normal_package() {
         return &_normal_package;
     }
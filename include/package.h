@@ -3,17 +3,25 @@
 #include <atomic>
 #include <functional>
 #include <memory>
-#include <set>
+#include <memory_resource>
 #include <string>
+#include <type_traits>
 #include <unordered_map>
-#include <list>
+#include <vector>
 
+#include "flat_hash_map.h"
+#include "goods_type_enum.h"
+#include "package_notify.h"
 #include "package_type_enum.h"
+#include "small_vector.h"
 
 class object;
+class package_journal;
+class package_view;
+class transaction_dedup;
 
 class goods;
-using goods_ptr = std::shared_ptr<goods>;   // 道具智能指针
+using goods_ptr = std::shared_ptr<const goods>;   // 道具智能指针（只读，格子里的对象可能是注册表共享的）
 
 class package_slot;
 class package;
@@ -21,6 +29,49 @@ using package_ptr = package*;
 
 using slot_id = uint32_t;
 static constexpr slot_id INVALID_SLOT = 0xFFFF;   // 标记无效的格子
+using slot_set = small_vector<slot_id, 4>;        // 有序格子列表（少量格子不分配堆内存）
+
+/// <summary>
+/// 批量放入的一项
+/// </summary>
+struct put_entry {
+    goods_ptr _goods = nullptr;   // 物品对象
+    uint32_t  _count = 0;         // 数量
+    bool      _overlap = true;    // 是否叠加
+};
+
+/// <summary>
+/// 批量扣除的一项
+/// </summary>
+struct rem_entry {
+    uint32_t _goods_id = 0;       // 物品配置ID
+    uint32_t _count = 0;          // 数量
+};
+
+/// <summary>
+/// 遍历时的格子（格子index + 格子对象）
+/// </summary>
+struct slot_entry {
+    slot_id       _slot = 0;          // 格子index
+    package_slot* _ptr = nullptr;     // 格子对象
+};
+
+/// <summary>
+/// 整理排序字段
+/// </summary>
+enum class pack_key : uint8_t {
+    type,           // 物品类型 升序
+    id,             // 物品配置ID 升序
+    count,          // 数量 升序
+    count_desc,     // 数量 降序
+};
+
+/// <summary>
+/// 整理排序规则（按 _keys 依次比较，全部相同时保持原来的先后顺序）
+/// </summary>
+struct pack_order {
+    pack_key _keys[3] = { pack_key::type, pack_key::id, pack_key::count_desc };
+};
 
 /// <summary>
 /// 背包格子
@@ -126,6 +177,7 @@ public:
         get,
         add,
         sub,
+        swp,
     };
 
     struct operator_info {
@@ -136,19 +188,65 @@ public:
         goods_ptr     _goods;     // 操作道具
         uint32_t _after_count;    // 操作后数量
     };
+
+    struct goods_slot_undo {
+        uint32_t _goods_id;       // 物品配置ID
+        slot_id  _slot;           // 格子index
+        bool     _added;          // true: 本次新增的映射（回滚删除）; false: 本次移除的映射（回滚加回）
+    };
+
+    using savepoint_id = uint32_t;
+
+    /// <summary>
+    /// 提交结果
+    /// </summary>
+    enum class commit_result : uint32_t {
+        ok,
+        conflict,       // 背包已被其他事务占用或修改，改动已回滚，可重试
+        replayed,       // 相同 transaction_mask 的事务已经提交过，没有执行（见 result()）
+    };
+
 private:
-    std::string _transaction_id;          // 事务ID
-    package_ptr _package = nullptr;       // 背包
-    std::list<operator_info> _list;       // 操作过程
+    struct backup_info {
+        slot_id      _slot;                    // 格子
+        package_slot _content;                 // 被操作前的格子内容
+        size_t       _prev_pos;                // 该格子上一次备份在 _backup 中的位置（没有为 SIZE_MAX）
+    };
+
+    struct savepoint_info {
+        size_t   _list_size;                   // _list 长度
+        size_t   _backup_size;                 // _backup 长度
+        size_t   _backup_goods_slot_size;      // _backup_goods_slot 长度
+        uint32_t _capacity_cur;                // 容量
+    };
+
+    //////////////////////////////////////////////////////////////////////////
+    // 事务内的容器都从线程内的内存池分配（见 local_resource），
+    // 预热后常规的小事务不再走全局堆
+    uint64_t _transaction_id = 0;                                       // 事务ID（util::id_generator）
+    package_ptr _package = nullptr;                                     // 背包
+    bool _conflict = false;                                             // 未取得背包的写权限（其他事务正在操作）
+    uint64_t _base_version = 0;                                         // 事务基于的背包版本
+    uint64_t _transaction_mask = 0;                                     // transaction_mask 散列（0 为没有，不去重）
+    bool _replayed = false;                                             // 相同 mask 的事务已提交过（所有操作不执行）
+    uint64_t _result = 0;                                               // 事务结果（随 mask 记录，重放时返回）
+    std::pmr::vector<operator_info> _list{ local_resource() };          // 操作过程
+    size_t _list_committed = 0;                                         // _list 中已提交的长度（回滚不会低于它，notify 只发送这部分）
 
     //////////////////////////////////////////////////////////////////////////
     // history backup
-    std::unordered_map<slot_id, package_slot> _backup;                   // 被操作前的格子内容 slot_id, slot
-    std::unordered_map<uint32_t, std::set<slot_id>> _backup_goods_slot;  // 被操作前的物品配置id->格子
-    uint32_t _backup_capacity_cur = 0;                                   // 被操作前的容量
-    uint32_t _backup_empty_slot_count = 0;                               // 被操作前的空格子数量
-    slot_id  _backup_empty_slot_next = INVALID_SLOT;                     // 被操作前的下一个空格子
+    std::pmr::vector<backup_info> _backup{ local_resource() };                          // 被操作前的格子内容（按备份顺序）
+    std::pmr::unordered_map<slot_id, size_t> _backup_pos{ local_resource() };           // slot_id -> 最近一次备份在 _backup 中的位置
+    std::pmr::vector<goods_slot_undo> _backup_goods_slot{ local_resource() };           // 物品配置id->格子 的变更记录（只记录改动过的映射）
+    bool _backup_goods_slot_rebuild = false;                                            // 映射被整体重建过（auto_pack），回滚时 re_init
+    uint32_t _backup_capacity_cur = 0;                                                  // 被操作前的容量
+    std::pmr::vector<savepoint_info> _savepoints{ local_resource() };                   // 保存点
     //////////////////////////////////////////////////////////////////////////
+
+    /// <summary>
+    /// 线程内的事务内存池（operator 只能在创建它的线程上使用和销毁）
+    /// </summary>
+    static std::pmr::memory_resource* local_resource();
     
 public:
     explicit package_operator(package_ptr package);
@@ -182,8 +280,28 @@ public:
     /// <param name="goods_id">道具配置ID</param>
     /// <param name="goods_count">扣除数量</param>
     /// <param name="slot">具体格子(若有效则只扣除这一个格子，若无效则遍历背包)</param>
+    /// <param name="require_all">数量不足时不扣除（不修改任何格子，返回0）</param>
     /// <returns>扣除了几个</returns>
-    uint32_t rem(uint32_t goods_id, uint32_t goods_count, slot_id slot = INVALID_SLOT);
+    uint32_t rem(uint32_t goods_id, uint32_t goods_count, slot_id slot = INVALID_SLOT, bool require_all = false);
+
+    /// <summary>
+    /// 批量添加物品（同物品的多项先合并成一组，先补已有堆叠，再按升序分配空格子）
+    /// 每组在一个格子上只写一次，操作记录（_list）按 (组, 格子) 各一条，没有合并成一条批量记录；
+    /// 格子备份与单个 put 相同，同一格子在一个保存点内只备份一次
+    /// </summary>
+    /// <param name="entries">物品列表</param>
+    /// <param name="placed">可选，输出每一项添加了几个</param>
+    /// <returns>共添加了几个</returns>
+    uint32_t put_many(const std::vector<put_entry>& entries, std::vector<uint32_t>* placed = nullptr);
+
+    /// <summary>
+    /// 批量扣除物品（同物品合并后按格子顺序扣除）
+    /// </summary>
+    /// <param name="entries">物品列表</param>
+    /// <param name="removed">可选，输出每一项扣除了几个</param>
+    /// <param name="require_all">任意物品数量不足时全部不扣除（不修改任何格子，返回0）</param>
+    /// <returns>共扣除了几个</returns>
+    uint32_t rem_many(const std::vector<rem_entry>& entries, std::vector<uint32_t>* removed = nullptr, bool require_all = false);
 
     /// <summary>
     /// 交换物品（相同道具可merge则从2 merge to 1）
@@ -200,12 +318,71 @@ public:
     /// <returns>是否成功</returns>
     bool aug(uint32_t inc = 1) const;
 
+    /// <summary>
+    /// 转移物品到另一个背包（整堆转移时沿用原物品对象，不重新创建）
+    /// </summary>
+    /// <param name="dst">目标背包的操作对象</param>
+    /// <param name="src_slot">源格子</param>
+    /// <param name="dst_slot">目标格子(无效格子表示由系统查找)</param>
+    /// <param name="count">数量（超出源格子数量时按整堆）</param>
+    /// <returns>转移了几个</returns>
+    uint32_t move_to(package_operator& dst, slot_id src_slot, slot_id dst_slot, uint32_t count);
+
     /// <summary>
     /// 提交
     /// </summary>
     /// <returns>自身引用，建议链式调用release</returns>
     package_operator& commit();
 
+    /// <summary>
+    /// 乐观提交：背包版本与事务基于的版本（开始时或 expect_version 指定）不一致则回滚
+    /// </summary>
+    /// <returns>ok / conflict（改动已回滚，可重新读取后重试）</returns>
+    commit_result try_commit();
+
+    /// <summary>
+    /// 指定事务基于的背包版本（先不开事务读取背包并记录 version()，计算后再开事务写入，
+    /// try_commit 时校验期间背包没有被修改）
+    /// </summary>
+    /// <param name="version">读取时的背包版本</param>
+    void expect_version(uint64_t version) {
+        _base_version = version;
+    }
+
+    /// <summary>
+    /// 是否没有取得背包的写权限（此时所有操作都失败，commit 无效，try_commit 返回 conflict）
+    /// </summary>
+    bool conflicted() const {
+        return _conflict;
+    }
+
+    /// <summary>
+    /// 事务ID（每个 operator 创建时分配，全局唯一；重放时为原事务的ID）
+    /// </summary>
+    uint64_t transaction_id() const {
+        return _transaction_id;
+    }
+
+    /// <summary>
+    /// 相同 transaction_mask 的事务已经提交过（此时所有操作都不执行，commit 无效，try_commit 返回 replayed）
+    /// </summary>
+    bool replayed() const {
+        return _replayed;
+    }
+
+    /// <summary>
+    /// 事务结果（调用方定义，commit 时随 mask 记录；重放时为原事务提交时的值）
+    /// </summary>
+    uint64_t result() const {
+        return _result;
+    }
+
+    package_operator& result(uint64_t value) {
+        if (!_replayed)
+            _result = value;
+        return *this;
+    }
+
     /// <summary>
     /// 回滚
     /// </summary>
@@ -213,19 +390,71 @@ public:
     package_operator& rollback();
 
     /// <summary>
-    /// 通知
+    /// 创建保存点（可嵌套）
+    /// </summary>
+    /// <returns>保存点ID</returns>
+    savepoint_id savepoint();
+
+    /// <summary>
+    /// 回滚到保存点（只撤销保存点之后的操作，保存点本身保留，之后的保存点失效）
+    /// </summary>
+    /// <param name="sp">保存点ID</param>
+    /// <returns>是否成功</returns>
+    bool rollback_to(savepoint_id sp);
+
+    /// <summary>
+    /// 释放保存点（保留改动，该保存点及之后的保存点失效）
+    /// </summary>
+    /// <param name="sp">保存点ID</param>
+    /// <returns>是否成功</returns>
+    bool release_savepoint(savepoint_id sp);
+
+    /// <summary>
+    /// 通知（合并 _list 中已提交的部分为每个格子的最终状态，一条消息发给背包的 notify_sink）
+    /// 未提交的操作留到提交后再通知；release 时还没通知的已提交操作会自动通知
     /// </summary>
     virtual void notify();
 
 private:
 
     friend class package;
+    friend class package_transaction;
 
     /// <summary>
-    /// 整理背包
+    /// 整理背包（同配置可叠加的物品合并成满堆，按 order 排序后一次写回，只改动内容变化的格子）
     /// </summary>
+    /// <param name="order">排序规则</param>
+    /// <param name="changed">可选，输出内容变化的格子（升序）</param>
     /// <returns>是否成功</returns>
-    bool auto_pack();
+    bool auto_pack(const pack_order& order, std::vector<slot_id>* changed);
+
+    /// <summary>
+    /// 取得背包的写权限（失败则进入冲突状态）
+    /// </summary>
+    void acquire();
+
+    /// <summary>
+    /// 按 transaction_mask 查找已提交的事务（构造时调用）
+    /// </summary>
+    void check_replay(const std::string& transaction_mask);
+
+    /// <summary>
+    /// 不执行任何操作（冲突或重放）
+    /// </summary>
+    bool blocked() const {
+        return _conflict || _replayed;
+    }
+
+    /// <summary>
+    /// 记录事务开始时的背包状态（构造 & commit 时调用；冲突时不读取背包）
+    /// </summary>
+    void backup_begin();
+
+    /// <summary>
+    /// 回滚到指定状态
+    /// </summary>
+    /// <param name="info">目标状态</param>
+    void inner_rollback(const savepoint_info& info);
 
     /// <summary>
     /// 备份格子
@@ -233,6 +462,33 @@ private:
     /// <param name="slot">格子index</param>
     void backup_slot(slot_id slot);
 
+    /// <summary>
+    /// 提交时把本次事务改动的格子写入提交日志（失败时不推进 journal_seq，见 package_journal::failed）
+    /// </summary>
+    /// <param name="slots">改动过的格子（升序）</param>
+    void journal_commit(const std::vector<slot_id>& slots);
+
+    /// <summary>
+    /// 添加道具对应格子标记（记录变更用于回滚）
+    /// </summary>
+    void add_goods_slot(uint32_t goods_id, slot_id slot);
+
+    /// <summary>
+    /// 移除道具对应格子标记（记录变更用于回滚）
+    /// </summary>
+    void rem_goods_slot(uint32_t goods_id, slot_id slot);
+
+    /// <summary>
+    /// 对指定格子添加物品
+    /// </summary>
+    /// <param name="pGoods">物品对象</param>
+    /// <param name="goods_count">添加数量</param>
+    /// <param name="slot">格子index</param>
+    /// <param name="pSlot">格子对象（空格子或可叠加的同物品格子）</param>
+    /// <param name="adopt">空格子直接使用 pGoods（转移整堆时），否则从注册表获取</param>
+    /// <returns>实际添加数量</returns>
+    uint32_t inner_put(goods_ptr pGoods, uint32_t goods_count, slot_id slot, package_slot* pSlot, bool adopt = false);
+
     /// <summary>
     /// 对指定格子扣除物品
     /// </summary>
@@ -258,14 +514,40 @@ protected:
     object* _owner;
 private:
     package_type_enum _type = package_type_enum::normal;  // 背包类型
+    package_notify_sink* _notify_sink = nullptr;          // 变更通知接收者
+    package_journal* _journal = nullptr;                  // 提交日志
+    uint64_t _journal_seq = 0;                            // 已写入/已恢复的最后一条日志序号
+    bool _view_enabled = false;                           // 提交时发布只读视图
+    std::unique_ptr<transaction_dedup> _dedup;            // 已提交事务的去重记录（首次使用 transaction_mask 时创建）
+    std::shared_ptr<const package_view> _view;            // 最后一次提交的只读视图（std::atomic_load/atomic_store 访问）
     uint32_t _capacity_max = 0;                           // 最大背包容量
     uint32_t _capacity_cur = 0;                           // 当前背包容量
     std::vector<package_slot> _slot_array;                // 背包格子 size() == _capacity_max
 
-    uint32_t _empty_slot_count = 0;                       // empty slot 数量 （快速检查使用）
-    slot_id  _empty_slot_next = INVALID_SLOT;             // empty slot, change at consume/throw （快速检查使用）
+    //////////////////////////////////////////////////////////////////////////
+    // 格子扫描用的紧凑数组（与 _slot_array 下标一致，由 sync_slot/re_init 维护），
+    // 查找格子时不再访问 goods 对象
+    std::vector<uint32_t> _slot_goods_id;                 // 物品配置ID
+    std::vector<uint32_t> _slot_count;                    // 数量（0 为空格子）
+    std::vector<uint32_t> _slot_overlap_max;              // 最大叠加数量
+    std::vector<goods_type_enum> _slot_goods_type;        // 物品类型
+    std::vector<uint64_t> _slot_free_bits;                // 空格子位图（1 为空），按 64 位查找
+    //////////////////////////////////////////////////////////////////////////
+
+    uint32_t _empty_slot_count = 0;                       // [0, _capacity_cur) 内 empty slot 数量（与位图一致）
+
+    flat_hash_map<uint32_t, slot_set> _goods_slot;        // 物品配置id->格子（有序）
+
+    struct goods_partial {
+        slot_set _slots;              // 未满的格子（有序）
+        uint32_t _room = 0;           // 未满格子的剩余可叠加数量之和
+    };
+    flat_hash_map<uint32_t, goods_partial> _goods_partial;        // 物品配置id->未满堆叠（由 sync_slot 维护）
+    flat_hash_map<uint32_t, uint64_t> _goods_count;               // 物品配置id->总数量（由 sync_slot 维护）
 
-    std::unordered_map<uint32_t, std::set<slot_id>> _goods_slot;  // 物品配置id->格子
+    std::vector<uint64_t> _dirty_bits;                    // 已提交但未保存的格子位图（1 为脏）
+    uint32_t _dirty_count = 0;                            // 脏格子数量
+    bool _dirty_capacity = false;                         // 容量已变化但未保存
 
 public:
     package(object* owner_, package_type_enum type_, uint32_t capacity_max_);
@@ -277,22 +559,93 @@ public:
     package& operator = (const package&) = delete;
 
     /// <summary>
-    /// 初始化 _empty_slot_count, _empty_slot_next, _goods_slot
+    /// 初始化 紧凑数组, 空格子位图, _empty_slot_count, _goods_slot
     /// </summary>
     /// <returns>是否成功</returns>
     bool re_init();
 
+    object* owner() const {
+        return _owner;
+    }
+
     package_type_enum type_enum() const {
         return _type;
     }
 
+    package_notify_sink* notify_sink() const {
+        return _notify_sink;
+    }
+
+    void notify_sink(package_notify_sink* sink) {
+        _notify_sink = sink;
+    }
+
+    package_journal* journal() const {
+        return _journal;
+    }
+
+    void journal(package_journal* journal_) {
+        _journal = journal_;
+    }
+
+    static constexpr uint32_t dedup_capacity_default = 64;
+
+    /// <summary>
+    /// 设置事务去重记录的大小（会清空已有记录）
+    /// </summary>
+    /// <param name="capacity">最多保留的记录数</param>
+    /// <param name="horizon_mill">时间窗口（毫秒，0 为不限）</param>
+    void dedup_limit(uint32_t capacity, uint32_t horizon_mill = 0);
+
+    const transaction_dedup* dedup() const {
+        return _dedup.get();
+    }
+
+    uint64_t journal_seq() const {
+        return _journal_seq;
+    }
+
+    /// <summary>
+    /// 开启/关闭只读视图（只能在背包所在线程、没有未提交的操作时调用）
+    /// 开启后每次有改动的提交发布一个新视图
+    /// </summary>
+    /// <param name="enable">是否开启</param>
+    void enable_view(bool enable);
+
+    /// <summary>
+    /// 最后一次提交时的只读视图（任意线程可调用，不等待正在进行的事务；未开启时为 nullptr）
+    /// </summary>
+    std::shared_ptr<const package_view> view() const;
+
+    /// <summary>
+    /// 背包版本（每次有改动的提交、加载快照、重放日志后递增）
+    /// </summary>
+    uint64_t version() const {
+        return _version.load(std::memory_order_acquire);
+    }
+
+    void journal_seq(uint64_t seq) {
+        _journal_seq = seq;
+    }
+
+    /// <summary>
+    /// 直接写入格子（加载/恢复用，不走事务；全部写完后需要 re_init）
+    /// </summary>
+    /// <param name="slot">格子index</param>
+    /// <param name="pGoods">物品对象（空表示清空）</param>
+    /// <param name="count">数量</param>
+    /// <returns>是否成功</returns>
+    bool restore_slot(slot_id slot, goods_ptr pGoods, uint32_t count);
+
     uint32_t capacity_cur() const {
         return _capacity_cur;
     }
 
-    void capacity_cur(uint32_t cur) {
-        _capacity_cur = cur;
-    }
+    /// <summary>
+    /// 设置当前容量（同步空格子数量）
+    /// </summary>
+    /// <param name="cur">容量，不超过 capacity_max</param>
+    void capacity_cur(uint32_t cur);
 
     uint32_t capacity_max() const {
         return _capacity_max;
@@ -303,7 +656,7 @@ public:
     }
 
     slot_id empty_slot_next() const {
-        return _empty_slot_next;
+        return first_empty_slot(0);
     }
 
     package_slot* get_slot(slot_id slot) {
@@ -312,38 +665,277 @@ public:
     }
 
     slot_id get_empty_slot_id() const {
-        if (_empty_slot_next != INVALID_SLOT 
-            && _slot_array.at(_empty_slot_next).empty()) {
-            return _empty_slot_next;
+        return first_empty_slot(0);
+    }
+
+    /// <summary>
+    /// 从 start 开始（含）第一个空格子
+    /// </summary>
+    /// <param name="start">开始格子</param>
+    /// <returns>格子ID，没有则 INVALID_SLOT</returns>
+    slot_id first_empty_slot(slot_id start) const;
+
+    /// <summary>
+    /// 从 start 开始（含）第一个非空格子
+    /// </summary>
+    /// <param name="start">开始格子</param>
+    /// <returns>格子ID，没有则 INVALID_SLOT</returns>
+    slot_id first_occupied_slot(slot_id start) const;
+
+    /// <summary>
+    /// 已有堆叠还能叠加的数量（不含空格子）
+    /// </summary>
+    /// <param name="goods_id">物品配置ID</param>
+    /// <returns>剩余可叠加数量</returns>
+    uint32_t stack_room(uint32_t goods_id) const;
+
+    /// <summary>
+    /// 物品总数量
+    /// </summary>
+    /// <param name="goods_id">物品配置ID</param>
+    /// <returns>背包内该物品的数量</returns>
+    uint64_t count_of(uint32_t goods_id) const;
+
+    /// <summary>
+    /// 已提交但未保存的格子数量
+    /// </summary>
+    uint32_t dirty_count() const {
+        return _dirty_count;
+    }
+
+    /// <summary>
+    /// 是否有未保存的改动（格子或容量）
+    /// </summary>
+    bool dirty() const {
+        return _dirty_count != 0 || _dirty_capacity;
+    }
+
+    /// <summary>
+    /// 取出未保存的改动并清空（增量保存用）
+    /// </summary>
+    /// <param name="slots">输出: 脏格子（升序）</param>
+    /// <returns>容量是否变化</returns>
+    bool collect_dirty(std::vector<slot_id>& slots);
+
+    /// <summary>
+    /// 检查一组物品能否全部放入（只读，不修改格子）
+    /// 按顺序计算：先补已有堆叠（叠加时），再占空格子；前面的项新开的堆叠后面同物品可继续补
+    /// </summary>
+    /// <param name="entries">物品列表</param>
+    /// <param name="placed">可选，输出每一项能放入的数量</param>
+    /// <returns>是否全部放得下</returns>
+    bool can_put_all(const std::vector<put_entry>& entries, std::vector<uint32_t>* placed = nullptr) const;
+
+    /// <summary>
+    /// 自动整理（严格限制，不能用在未完成的operator中间使用）
+    /// </summary>
+    /// <param name="order">排序规则</param>
+    /// <param name="changed">可选，输出内容变化的格子（升序）</param>
+    void  auto_pack(const pack_order& order = pack_order(), std::vector<slot_id>* changed = nullptr);
+
+    /// <summary>
+    /// 遍历格子（回调直接内联，不经过 std::function）
+    /// </summary>
+    /// <param name="start">开始格子</param>
+    /// <param name="caller">执行函数 caller(slot_id, package_slot*) 或 caller(package_slot*). 返回 false 停止（break），返回 void 遍历全部</param>
+    template<typename _Fn>
+    void for_each_slot(_Fn&& caller) {
+        for_each_slot(0, std::forward<_Fn>(caller));
+    }
+
+    template<typename _Fn>
+    void for_each_slot(slot_id start, _Fn&& caller) {
+        for (slot_id one = start; one < _capacity_cur; ++one) {
+            if (!invoke_slot(caller, one, &_slot_array[one]))
+                break;
+        }
+    }
+
+    template<typename _Fn>
+    void for_each_slot(_Fn&& caller) const {
+        for_each_slot(0, std::forward<_Fn>(caller));
+    }
+
+    template<typename _Fn>
+    void for_each_slot(slot_id start, _Fn&& caller) const {
+        for (slot_id one = start; one < _capacity_cur; ++one) {
+            if (!invoke_slot(caller, one, &_slot_array[one]))
+                break;
         }
+    }
+
+    /// <summary>
+    /// 按条件筛选的格子范围（按格子升序，只访问非空格子，可用于 range-for）
+    /// 遍历期间不能增删格子内的物品
+    /// </summary>
+    template<typename _Pred>
+    class slot_range {
+    private:
+        package* _package = nullptr;
+        _Pred _pred;
+
+    public:
+        class iterator {
+        private:
+            const slot_range* _range = nullptr;
+            slot_id _slot = INVALID_SLOT;
+
+            void seek(slot_id start) {
+                _slot = _range->_package->first_occupied_slot(start);
+                while (_slot != INVALID_SLOT && !_range->_pred(*_range->_package, _slot))
+                    _slot = _range->_package->first_occupied_slot(_slot + 1);
+            }
 
-        for (slot_id i = 0; i < _capacity_cur; ++i) {
-            if (_slot_array.at(i).empty()) {
-                return i;
+        public:
+            iterator(const slot_range* range, slot_id start) : _range(range) {
+                if (start != INVALID_SLOT)
+                    seek(start);
             }
+
+            slot_entry operator*() const {
+                return slot_entry{ _slot, &_range->_package->_slot_array[_slot] };
+            }
+
+            iterator& operator++() {
+                seek(_slot + 1);
+                return *this;
+            }
+
+            bool operator == (const iterator& rhs) const { return _slot == rhs._slot; }
+            bool operator != (const iterator& rhs) const { return _slot != rhs._slot; }
+        };
+
+        slot_range(package* package_, _Pred pred) : _package(package_), _pred(std::move(pred)) {
         }
-        return INVALID_SLOT;
+
+        iterator begin() const { return iterator(this, 0); }
+        iterator end() const { return iterator(this, INVALID_SLOT); }
+    };
+
+    /// <summary>
+    /// 某个物品配置所在格子的范围（按格子升序，直接遍历 _goods_slot，可用于 range-for）
+    /// 遍历期间不能增删格子内的物品
+    /// </summary>
+    class goods_slot_range {
+    private:
+        package* _package = nullptr;
+        const slot_set* _slots = nullptr;
+
+    public:
+        class iterator {
+        private:
+            package* _package = nullptr;
+            const slot_id* _pos = nullptr;
+
+        public:
+            iterator(package* package_, const slot_id* pos) : _package(package_), _pos(pos) {
+            }
+
+            slot_entry operator*() const {
+                return slot_entry{ *_pos, &_package->_slot_array[*_pos] };
+            }
+
+            iterator& operator++() {
+                ++_pos;
+                return *this;
+            }
+
+            bool operator == (const iterator& rhs) const { return _pos == rhs._pos; }
+            bool operator != (const iterator& rhs) const { return _pos != rhs._pos; }
+        };
+
+        goods_slot_range(package* package_, const slot_set* slots) : _package(package_), _slots(slots) {
+        }
+
+        iterator begin() const { return iterator(_package, _slots->begin()); }
+        iterator end() const { return iterator(_package, _slots->end()); }
+    };
+
+    /// <summary>
+    /// 全部非空格子
+    /// </summary>
+    auto occupied_slots() {
+        return slot_range<occupied_pred>(this, occupied_pred{});
     }
 
     /// <summary>
-    /// 自动整理（严格限制，不能用在未完成的operator中间使用）
+    /// 放着某个物品配置的格子
+    /// </summary>
+    /// <param name="goods_id">物品配置ID</param>
+    goods_slot_range slots_of(uint32_t goods_id) {
+        return goods_slot_range(this, &get_goods_slot(goods_id));
+    }
+
+    /// <summary>
+    /// 放着某个类型物品的格子
     /// </summary>
-    void  auto_pack();
+    /// <param name="type">物品类型</param>
+    auto slots_of_type(goods_type_enum type) {
+        return slot_range<goods_type_pred>(this, goods_type_pred{ type });
+    }
 
     /// <summary>
-    /// 遍历格子
+    /// 满足条件的非空格子
     /// </summary>
-    /// <param name="caller">执行函数. false 返回值停止（break）</param>
-    void for_each_slot(std::function<bool(package_slot*)>&&);
-    void for_each_slot(std::function<bool(slot_id, package_slot*)>&&);
+    /// <param name="pred">pred(const package&, slot_id) -> bool</param>
+    template<typename _Pred>
+    slot_range<std::decay_t<_Pred>> slots_if(_Pred&& pred) {
+        return slot_range<std::decay_t<_Pred>>(this, std::forward<_Pred>(pred));
+    }
 
-    void for_each_slot(slot_id, std::function<bool(package_slot*)>&&);
-    void for_each_slot(slot_id, std::function<bool(slot_id, package_slot*)>&&);
+    goods_type_enum slot_goods_type(slot_id slot) const {
+        return _slot_goods_type[slot];
+    }
+
+    uint32_t slot_goods_id(slot_id slot) const {
+        return _slot_goods_id[slot];
+    }
 
 private:
     friend class package_operator;
+    friend class package_journal;
+
+    struct occupied_pred {
+        bool operator()(const package&, slot_id) const {
+            return true;
+        }
+    };
+
+    struct goods_type_pred {
+        goods_type_enum _type;
+        bool operator()(const package& pkg, slot_id slot) const {
+            return pkg._slot_goods_type[slot] == _type;
+        }
+    };
+
+    /// <summary>
+    /// 调用遍历回调（兼容带/不带格子index、返回 bool/void 的回调）
+    /// </summary>
+    template<typename _Fn, typename _Slot>
+    static bool invoke_slot(_Fn& caller, slot_id slot, _Slot* pSlot) {
+        if constexpr (std::is_invocable_v<_Fn&, slot_id, _Slot*>) {
+            if constexpr (std::is_void_v<std::invoke_result_t<_Fn&, slot_id, _Slot*>>) {
+                caller(slot, pSlot);
+                return true;
+            }
+            else {
+                return static_cast<bool>(caller(slot, pSlot));
+            }
+        }
+        else {
+            if constexpr (std::is_void_v<std::invoke_result_t<_Fn&, _Slot*>>) {
+                caller(pSlot);
+                return true;
+            }
+            else {
+                return static_cast<bool>(caller(pSlot));
+            }
+        }
+    }
+    friend class package_snapshot;
 
-    std::atomic<bool> _operator_mark;     // 操作中的标记
+    std::atomic<bool> _operator_mark{ false };     // 操作中的标记
+    std::atomic<uint64_t> _version{ 0 };           // 版本（每次有改动的提交 +1）
 
     /// <summary>
     /// 交换格子内容
@@ -354,6 +946,8 @@ private:
         if (slot1 >= _capacity_cur || slot2 >= _capacity_cur)
             return false;
         std::swap(_slot_array[slot1], _slot_array[slot2]);
+        sync_slot(slot1);
+        sync_slot(slot2);
         return true;
     }
 
@@ -365,48 +959,87 @@ private:
     void cover_slot(slot_id index, const package_slot* slot) {
         if (index < _capacity_max) {
             _slot_array[index] = *slot;
+            sync_slot(index);
         }
     }
 
-    void add_empty_slot() {
-        _empty_slot_count = std::min(_capacity_cur, ++_empty_slot_count);
-    }
+    /// <summary>
+    /// 发布只读视图（复制有改动的格子所在的块）
+    /// </summary>
+    /// <param name="slots">改动过的格子，nullptr 表示全部重建</param>
+    void publish_view(const std::vector<slot_id>* slots);
 
-    void add_empty_slot(uint32_t inc) {
-        _empty_slot_count = std::min(_capacity_cur, _empty_slot_count + inc);
-    }
-    void sub_empty_slot() {
-        if (_empty_slot_count > 0) --_empty_slot_count;
-    }
     /// <summary>
-    /// 设置空格子标记
+    /// 标记格子已改动（提交时调用）
     /// </summary>
-    void set_empty_slot_next(slot_id slot) {
-        _empty_slot_next = std::min(_empty_slot_next, slot);
+    /// <param name="slot">格子index</param>
+    void mark_dirty(slot_id slot) {
+        const auto mask = 1ull << (slot & 63);
+        auto& bits = _dirty_bits[slot >> 6];
+        if ((bits & mask) == 0) {
+            bits |= mask;
+            ++_dirty_count;
+        }
     }
+
+    /// <summary>
+    /// 格子内容变化后同步紧凑数组
+    /// </summary>
+    /// <param name="slot">格子index</param>
+    void sync_slot(slot_id slot);
+
     /// <summary>
-    /// 重置空格子标记（带从头回溯概念）
+    /// 是否可填充到这个格子里（同 package_slot::can_filled，只读紧凑数组）
     /// </summary>
     /// <param name="slot">格子index</param>
-    void reset_empty_slot_next(slot_id slot);
+    /// <param name="goods_id">物品配置ID</param>
+    /// <param name="overlap">是否可叠加</param>
+    /// <returns>是否可填充</returns>
+    bool can_filled(slot_id slot, uint32_t goods_id, bool overlap) const {
+        const auto count = _slot_count[slot];
+        if (count == 0) return true;
+        return overlap && _slot_goods_id[slot] == goods_id && count < _slot_overlap_max[slot];
+    }
+
+    /// <summary>
+    /// [begin, end) 内空格子数量
+    /// </summary>
+    uint32_t count_empty_slot(slot_id begin, slot_id end) const;
+
+    /// <summary>
+    /// 减少物品总数量（归零时移除）
+    /// </summary>
+    void sub_goods_count(uint32_t goods_id, uint64_t count);
+
+    /// <summary>
+    /// 添加未满堆叠
+    /// </summary>
+    void add_goods_partial(uint32_t goods_id, slot_id slot, uint32_t room);
+    /// <summary>
+    /// 移除未满堆叠
+    /// </summary>
+    void rem_goods_partial(uint32_t goods_id, slot_id slot, uint32_t room);
+
     /// <summary>
     /// 获取已有物品所在格子信息
     /// </summary>
     /// <param name="goods_id"></param>
     /// <returns></returns>
-    const std::set<slot_id>& get_goods_slot(uint32_t goods_id);
+    const slot_set& get_goods_slot(uint32_t goods_id);
 
     /// <summary>
     /// 添加道具对应格子标记
     /// </summary>
-    void add_goods_slot(uint32_t goods_id, slot_id slot);
+    /// <returns>是否新增了映射</returns>
+    bool add_goods_slot(uint32_t goods_id, slot_id slot);
     /// <summary>
     /// 移除道具对应格子标记
     /// </summary>
-    void rem_goods_slot(uint32_t goods_id, slot_id slot);
+    /// <returns>是否移除了映射</returns>
+    bool rem_goods_slot(uint32_t goods_id, slot_id slot);
 
     /// <summary>
-    /// 从已经有该道具的格子找
+    /// 从已经有该道具的格子找（最靠前的未满堆叠）
     /// </summary>
     /// <param name="pGoods">物品对象</param>
     /// <param name="overlap">叠加</param>
@@ -422,7 +1055,7 @@ private:
     slot_id find_slot(goods_ptr pGoods, slot_id start, bool overlap);
 
     /// <summary>
-    /// 全部格子（暂时只给auto_pack使用）
+    /// 全部格子
     /// </summary>
     std::vector<package_slot>& __get_slot_array() {
         return _slot_array;
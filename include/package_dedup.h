@@ -0,0 +1,64 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "flat_hash_map.h"
+
+/// <summary>
+/// 已提交事务的去重记录（按 transaction_mask 的 64 位散列）
+/// 固定长度的环形队列 + 散列索引：满了覆盖最早的一条，超过时间窗口的记录视为不存在；
+/// 每条记录 32 字节，只保存散列不保存原始字符串
+/// </summary>
+class transaction_dedup final {
+public:
+    struct record {
+        uint64_t _mask_hash = 0;            // transaction_mask 散列（0 为空）
+        uint64_t _transaction_id = 0;       // 原事务ID
+        uint64_t _result = 0;               // 原事务的结果（调用方定义）
+        uint64_t _commit_mill = 0;          // 提交时间（毫秒，没有时间窗口时不读时钟，为 0）
+    };
+
+private:
+    std::vector<record> _ring;                      // 记录（按提交顺序循环覆盖）
+    flat_hash_map<uint64_t, uint32_t> _index;       // mask 散列 -> _ring 下标
+    uint32_t _next = 0;                             // 下一条写入位置
+    uint32_t _horizon_mill = 0;                     // 时间窗口（毫秒，0 为不限）
+
+public:
+    /// <param name="capacity">最多保留的记录数</param>
+    /// <param name="horizon_mill">时间窗口（毫秒，0 为不限）</param>
+    explicit transaction_dedup(uint32_t capacity, uint32_t horizon_mill = 0);
+
+    /// <summary>
+    /// transaction_mask 的散列（不为 0）
+    /// </summary>
+    static uint64_t hash(const std::string& mask);
+
+    /// <summary>
+    /// 查找记录
+    /// </summary>
+    /// <param name="mask_hash">mask 散列</param>
+    /// <returns>记录，没有或已过期为 nullptr</returns>
+    const record* find(uint64_t mask_hash) const;
+
+    /// <summary>
+    /// 记录一次提交（同一 mask 覆盖原记录）
+    /// </summary>
+    void insert(uint64_t mask_hash, uint64_t transaction_id, uint64_t result);
+
+    /// <summary>
+    /// 当前记录数
+    /// </summary>
+    size_t size() const {
+        return _index.size();
+    }
+
+    uint32_t horizon_mill() const {
+        return _horizon_mill;
+    }
+
+    uint32_t capacity() const {
+        return static_cast<uint32_t>(_ring.size());
+    }
+};
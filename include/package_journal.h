@@ -0,0 +1,165 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "package.h"
+
+class binary_writer;
+
+/// <summary>
+/// 背包提交日志（只追加写）
+/// 每次 commit 写一条记录：本次事务改动过的格子的最终内容（重做镜像），
+/// 重启后按顺序重放即可恢复到最后一次落盘的提交
+///
+/// 帧格式: len(u32) | crc32(u32) | payload(len)
+/// payload: version(u8) | seq(varint) | owner_uuid(varint) | type(varint) | capacity(varint) | n(varint)
+///          | n * [slot(varint) count(varint) (goods_id type overlap_max uuid)(varint, count>0)]
+///
+/// sync_interval_ms == 0 时每次 append 都直接写入并 fsync；
+/// 否则由后台线程按间隔把这段时间内的记录合并成一次写入 + fsync（组提交），
+/// 崩溃时最多丢失最后一个间隔内的提交
+///
+/// 写入/fsync 失败后日志进入失败状态（不会自动恢复）：之后的 append/flush 都返回 false，
+/// 调用方应检查 failed() 并停止提交，否则提交只留在内存里，重启后丢失
+/// </summary>
+class package_journal {
+private:
+    FILE* _file = nullptr;                  // 日志文件
+    uint32_t _sync_interval_ms = 0;         // 落盘间隔（0 为同步落盘）
+    std::string _pending;                   // 待写入的帧
+    std::string _writing;                   // 正在写入的帧（与 _pending 交换）
+    std::mutex _mutex;                      // 保护 _pending/_stop
+    std::mutex _write_mutex;                // 保证写入顺序（append 不等待 fsync）
+    std::condition_variable _cond;
+    std::thread _flusher;                   // 后台落盘线程
+    bool _stop = false;
+    std::atomic<bool> _failed{ false };     // 写入或 fsync 失败过
+
+    std::atomic<uint64_t> _append_count{ 0 };   // 写入记录数
+    std::atomic<uint64_t> _sync_count{ 0 };     // fsync 次数
+
+public:
+    package_journal() = default;
+    virtual ~package_journal();
+
+    // !! non copyable 
+    package_journal(const package_journal&) = delete;
+    package_journal& operator = (const package_journal&) = delete;
+
+    /// <summary>
+    /// 打开日志文件（追加写）
+    /// </summary>
+    /// <param name="path">文件路径</param>
+    /// <param name="sync_interval_ms">落盘间隔（毫秒，0 为每条同步落盘）</param>
+    /// <returns>是否成功</returns>
+    bool open(const std::string& path, uint32_t sync_interval_ms = 0);
+
+    /// <summary>
+    /// 落盘并关闭
+    /// </summary>
+    void close();
+
+    bool is_open() const {
+        return _file != nullptr;
+    }
+
+    /// <summary>
+    /// 追加一条记录
+    /// </summary>
+    /// <param name="payload">encode_entry 编码后的数据</param>
+    /// <returns>是否成功（同步落盘时包含写入和 fsync；组提交时只表示已进入待写队列，且之前没有失败过）</returns>
+    bool append(const std::string& payload);
+
+    /// <summary>
+    /// 把已追加的记录写入文件并 fsync
+    /// </summary>
+    /// <returns>是否成功</returns>
+    bool flush();
+
+    /// <summary>
+    /// 是否写入失败过（失败后丢弃之后的所有记录）
+    /// </summary>
+    bool failed() const {
+        return _failed.load(std::memory_order_acquire);
+    }
+
+    uint64_t append_count() const {
+        return _append_count;
+    }
+
+    uint64_t sync_count() const {
+        return _sync_count;
+    }
+
+    /// <summary>
+    /// 编码一条记录
+    /// </summary>
+    /// <param name="package">背包</param>
+    /// <param name="seq">序号</param>
+    /// <param name="slots">改动过的格子（升序）</param>
+    /// <param name="out">输出</param>
+    static void encode_entry(const package* package, uint64_t seq, const std::vector<slot_id>& slots, binary_writer& out);
+
+    /// <summary>
+    /// 日志索引：只读取、校验一次日志文件，按 owner_uuid 分组记录，
+    /// 启动时加载多个背包共用一个索引（不再每个背包都扫描整个文件）
+    /// </summary>
+    class replay_index {
+    private:
+        struct record {
+            uint32_t _type = 0;         // 背包类型
+            uint64_t _seq = 0;          // 序号
+            size_t _offset = 0;         // payload 在 _data 中的位置
+            uint32_t _size = 0;         // payload 长度
+        };
+
+        std::string _data;                                          // 日志文件内容（有效前缀）
+        std::unordered_map<uint64_t, std::vector<record>> _records; // owner_uuid->记录（文件顺序）
+        uint64_t _count = 0;                                        // 有效记录数
+
+    public:
+        /// <summary>
+        /// 读取日志文件并建立索引（遇到不完整或校验失败的记录即停止，之后的记录都不使用）
+        /// </summary>
+        /// <param name="path">文件路径</param>
+        /// <returns>文件是否可读</returns>
+        bool load(const std::string& path);
+
+        /// <summary>
+        /// 重放到背包（只应用属于该背包且序号大于 package->journal_seq() 的记录；重放的格子标记为未保存）
+        /// </summary>
+        /// <param name="package">背包（不能有未提交的操作）</param>
+        /// <returns>应用的记录数</returns>
+        uint64_t apply(package* package) const;
+
+        uint64_t size() const {
+            return _count;
+        }
+    };
+
+    /// <summary>
+    /// 重放日志到单个背包（读取整个文件；加载多个背包时使用 replay_index）
+    /// </summary>
+    /// <param name="path">文件路径</param>
+    /// <param name="package">背包（不能有未提交的操作）</param>
+    /// <returns>应用的记录数</returns>
+    static uint64_t replay(const std::string& path, package* package);
+
+private:
+    /// <summary>
+    /// 完整解码一条记录后再写入背包（解码或校验失败时不修改背包）
+    /// </summary>
+    /// <returns>是否应用</returns>
+    static bool apply_entry(const char* payload, uint32_t size, package* package);
+
+    bool write_pending();
+
+    void flusher_loop();
+};
@@ -0,0 +1,51 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "package_type_enum.h"
+
+class package;
+using slot_id = uint32_t;
+
+/// <summary>
+/// 格子最终状态（一个事务内同一格子只有一条）
+/// </summary>
+struct slot_delta {
+    slot_id  _slot = 0;          // 格子index
+    uint32_t _goods_id = 0;      // 物品配置ID
+    uint32_t _count = 0;         // 数量（0 表示清空）
+};
+
+/// <summary>
+/// 背包变更通知的接收者（网关/客户端同步等）
+/// </summary>
+class package_notify_sink {
+public:
+    virtual ~package_notify_sink() = default;
+
+    /// <summary>
+    /// 一个事务一条消息（message 是发送方线程内复用的缓冲区，只在调用期间有效；
+    /// 不应抛出异常，release/析构时的通知抛出的异常会被吞掉并计入 notify_failures）
+    /// </summary>
+    /// <param name="owner">背包</param>
+    /// <param name="message">encode_slot_delta 编码后的数据</param>
+    virtual void on_package_delta(package* owner, const std::string& message) = 0;
+};
+
+/// <summary>
+/// 编码格子增量
+/// version(u8) | type(varint) | capacity(varint) | n(varint) | n * [slot_gap(varint) count(varint) goods_id(varint, count>0)]
+/// 格子按升序排列，slot_gap 为与上一个格子的差值
+/// </summary>
+/// <param name="type">背包类型</param>
+/// <param name="capacity">当前容量</param>
+/// <param name="deltas">格子增量（需按格子升序且不重复）</param>
+/// <param name="out">输出</param>
+void encode_slot_delta(package_type_enum type, uint32_t capacity, const std::vector<slot_delta>& deltas, std::string& out);
+
+/// <summary>
+/// 解码格子增量
+/// </summary>
+/// <returns>是否成功</returns>
+bool decode_slot_delta(const void* data, size_t size, package_type_enum& type, uint32_t& capacity, std::vector<slot_delta>& deltas);
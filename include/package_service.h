@@ -0,0 +1,209 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "flat_hash_map.h"
+#include "mpsc_queue.h"
+
+class object;
+class package_service;
+
+/// <summary>
+/// 投递到分片的命令
+/// </summary>
+struct package_command : mpsc_node {
+    uint64_t _uuid = 0;           // 目标对象
+
+    virtual ~package_command() = default;
+
+    /// <summary>
+    /// 在分片线程上执行
+    /// </summary>
+    /// <param name="pObject">目标对象（不存在为 nullptr）</param>
+    virtual void execute(object* pObject) = 0;
+};
+
+/// <summary>
+/// 背包服务分片：一个工作线程独占一组对象，命令按投递顺序串行执行
+/// 同一对象的背包只会被一个线程操作，不会触发 _operator_mark
+/// </summary>
+class package_shard final {
+private:
+    friend class package_service;
+
+    mpsc_queue _queue;                                              // 命令队列
+    flat_hash_map<uint64_t, std::unique_ptr<object>> _objects;      // uuid -> 对象（只在分片线程访问）
+    std::thread _thread;
+
+    std::atomic<bool> _sleeping{ false };                           // 工作线程准备休眠
+    std::atomic<bool> _stop{ false };
+    std::mutex _mutex;
+    std::condition_variable _cond;
+
+    std::atomic<uint64_t> _executed{ 0 };                           // 已执行命令数
+    std::atomic<uint64_t> _failed{ 0 };                             // 抛出异常的命令数（future 命令的异常交给 future，不计入）
+
+public:
+    package_shard() = default;
+    ~package_shard();
+
+    // !! non copyable 
+    package_shard(const package_shard&) = delete;
+    package_shard& operator = (const package_shard&) = delete;
+
+    uint64_t executed() const {
+        return _executed.load(std::memory_order_relaxed);
+    }
+
+    uint64_t failed() const {
+        return _failed.load(std::memory_order_relaxed);
+    }
+
+    /// <summary>
+    /// 查找对象（只能在分片线程上调用）
+    /// </summary>
+    object* find(uint64_t uuid);
+
+private:
+    void start();
+
+    void stop();
+
+    void post(package_command* command);
+
+    void run();
+};
+
+/// <summary>
+/// 背包服务：按 uuid 把对象分到 N 个分片（工作线程），
+/// 调用方在任意线程投递命令，通过 future 或回调取得结果
+/// </summary>
+class package_service final {
+private:
+    std::vector<std::unique_ptr<package_shard>> _shards;
+
+    template<typename _Fn, typename _Result>
+    struct future_command final : package_command {
+        _Fn _fn;
+        std::promise<_Result> _promise;
+
+        explicit future_command(_Fn&& fn) : _fn(std::move(fn)) {
+        }
+
+        void execute(object* pObject) override {
+            try {
+                if constexpr (std::is_void_v<_Result>) {
+                    _fn(pObject);
+                    _promise.set_value();
+                }
+                else {
+                    _promise.set_value(_fn(pObject));
+                }
+            }
+            catch (...) {
+                _promise.set_exception(std::current_exception());
+            }
+        }
+    };
+
+    template<typename _Fn, typename _Callback>
+    struct callback_command final : package_command {
+        _Fn _fn;
+        _Callback _callback;
+
+        callback_command(_Fn&& fn, _Callback&& callback) : _fn(std::move(fn)), _callback(std::move(callback)) {
+        }
+
+        void execute(object* pObject) override {
+            if constexpr (std::is_void_v<std::invoke_result_t<_Fn&, object*>>) {
+                _fn(pObject);
+                _callback();
+            }
+            else {
+                _callback(_fn(pObject));
+            }
+        }
+    };
+
+public:
+    /// <summary>
+    /// 创建并启动服务
+    /// </summary>
+    /// <param name="shard_count">分片（工作线程）数量</param>
+    explicit package_service(uint32_t shard_count);
+
+    /// <summary>
+    /// 执行完已投递的命令后停止
+    /// </summary>
+    ~package_service();
+
+    // !! non copyable 
+    package_service() = delete;
+    package_service(const package_service&) = delete;
+    package_service& operator = (const package_service&) = delete;
+
+    uint32_t shard_count() const {
+        return static_cast<uint32_t>(_shards.size());
+    }
+
+    uint32_t shard_of(uint64_t uuid) const {
+        return static_cast<uint32_t>(flat_hash<uint64_t>()(uuid) % _shards.size());
+    }
+
+    const package_shard& shard(uint32_t index) const {
+        return *_shards[index];
+    }
+
+    /// <summary>
+    /// 创建对象（已存在则不创建）
+    /// </summary>
+    /// <param name="uuid">对象uuid</param>
+    /// <returns>是否创建</returns>
+    std::future<bool> add_object(uint64_t uuid);
+
+    /// <summary>
+    /// 移除对象
+    /// </summary>
+    /// <param name="uuid">对象uuid</param>
+    /// <returns>是否移除</returns>
+    std::future<bool> remove_object(uint64_t uuid);
+
+    /// <summary>
+    /// 投递命令，fn(object*) 在对象所在分片线程上执行（对象不存在时参数为 nullptr）
+    /// </summary>
+    /// <param name="uuid">对象uuid</param>
+    /// <param name="fn">命令</param>
+    /// <returns>fn 的返回值（fn 抛出的异常由 future::get 重新抛出）</returns>
+    template<typename _Fn>
+    auto post(uint64_t uuid, _Fn&& fn) {
+        using _Func = std::decay_t<_Fn>;
+        using _Result = std::invoke_result_t<_Func&, object*>;
+        auto command = new future_command<_Func, _Result>(_Func(std::forward<_Fn>(fn)));
+        auto result = command->_promise.get_future();
+        command->_uuid = uuid;
+        _shards[shard_of(uuid)]->post(command);
+        return result;
+    }
+
+    /// <summary>
+    /// 投递命令，完成后在分片线程上调用 callback(fn 的返回值)
+    /// </summary>
+    /// <param name="uuid">对象uuid</param>
+    /// <param name="fn">命令</param>
+    /// <param name="callback">回调（不要在回调中阻塞；fn 或回调抛出异常时分片继续运行，计入 shard().failed()）</param>
+    template<typename _Fn, typename _Callback>
+    void post(uint64_t uuid, _Fn&& fn, _Callback&& callback) {
+        using _Func = std::decay_t<_Fn>;
+        using _Cb = std::decay_t<_Callback>;
+        auto command = new callback_command<_Func, _Cb>(_Func(std::forward<_Fn>(fn)), _Cb(std::forward<_Callback>(callback)));
+        command->_uuid = uuid;
+        _shards[shard_of(uuid)]->post(command);
+    }
+};
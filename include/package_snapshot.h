@@ -0,0 +1,45 @@
+#pragma once
+#include <cstdint>
+#include <string>
+
+#include "package.h"
+
+class binary_writer;
+
+/// <summary>
+/// 背包快照（登录加载/下线保存）
+///
+/// version(u8) | type(varint) | capacity_max(varint) | capacity_cur(varint) | journal_seq(varint)
+/// | goods_n(varint) | goods_n * [goods_id type overlap_max](varint)
+/// | run_n(varint) | run_n * [run_head(varint) slots]
+///
+/// run_head = (length << 1) | occupied，连续的空格子只占一个 run_head；
+/// 非空 run 后跟 length 个格子: goods_index(varint) count(varint) (uuid(varint)，有实例状态的物品)
+/// goods_index 指向快照内的物品配置表，末尾的空格子不写
+///
+/// 读取不拷贝数据，可以直接读内存映射的文件；快照完整校验通过后才写入背包
+/// </summary>
+class package_snapshot {
+public:
+    static constexpr uint8_t version = 1;
+
+    /// <summary>
+    /// 保存快照
+    /// </summary>
+    /// <param name="package">背包</param>
+    /// <param name="out">输出</param>
+    static void save(const package* package, binary_writer& out);
+
+    /// <summary>
+    /// 加载快照（覆盖背包全部格子，一次线性遍历重建索引）
+    /// </summary>
+    /// <param name="data">快照数据（可以是内存映射的缓冲区）</param>
+    /// <param name="size">数据长度</param>
+    /// <param name="package">背包（类型一致、最大容量不小于快照，且不能有未提交的操作）</param>
+    /// <returns>是否成功（失败时背包不变）</returns>
+    static bool load(const void* data, size_t size, package* package);
+
+    static bool load(const std::string& data, package* package) {
+        return load(data.data(), data.size(), package);
+    }
+};
@@ -0,0 +1,186 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+#include "util.h"
+
+/// <summary>
+/// 热路径统计开关（-DPACKAGE_STATS=0 时统计代码全部编译掉，collect 返回全 0）
+/// </summary>
+#ifndef PACKAGE_STATS
+#define PACKAGE_STATS 1
+#endif
+
+/// <summary>
+/// 计数器
+/// </summary>
+enum class stats_counter : uint32_t {
+    find_calls,             // find_slot 次数
+    find_start_hit,         // find_slot 起始格子直接可用
+    empty_scans,            // 空格子位图查找次数
+    empty_scan_words,       // 空格子位图查找扫描的字数（每字 64 格）
+    partial_hit,            // 未满堆叠索引命中（直接补已有堆叠）
+    partial_miss,           // 未满堆叠索引未命中（需要找空格子）
+    rem_slot_copy,          // rem 拷贝的格子列表长度
+    commits,                // 有改动的提交
+    rollbacks,              // 有改动的回滚
+    mark_conflicts,         // 背包已被其他事务占用
+    version_conflicts,      // try_commit 版本不一致
+    replays,                // transaction_mask 重放
+    notify_failures,        // release 时通知接收者抛出异常
+    count
+};
+
+/// <summary>
+/// 直方图（按 2 的幂分桶；*_ns 为耗时，按 1/latency_sample 抽样）
+/// </summary>
+enum class stats_histogram : uint32_t {
+    put_ns,
+    rem_ns,
+    swp_ns,
+    aug_ns,
+    move_ns,
+    auto_pack_ns,
+    commit_ns,
+    rollback_ns,
+    backup_slots,           // 每个事务（提交/回滚时）备份的格子数
+    backup_goods_slot,      // 每个事务的 物品配置id->格子 变更记录数
+    count
+};
+
+/// <summary>
+/// 统计快照（所有线程累加，只增不减；需要速率时由采集方对两次快照求差）
+/// </summary>
+struct package_stats_snapshot {
+    static constexpr uint32_t counter_count = static_cast<uint32_t>(stats_counter::count);
+    static constexpr uint32_t histogram_count = static_cast<uint32_t>(stats_histogram::count);
+    static constexpr uint32_t bucket_count = 64;    // 桶 0: 0，桶 i: [2^(i-1), 2^i)
+
+    uint64_t _counters[counter_count] = {};
+    uint64_t _buckets[histogram_count][bucket_count] = {};
+
+    uint64_t counter(stats_counter name) const {
+        return _counters[static_cast<uint32_t>(name)];
+    }
+
+    /// <summary>
+    /// 直方图样本数
+    /// </summary>
+    uint64_t count(stats_histogram name) const;
+
+    /// <summary>
+    /// 分位数（返回所在桶的上界）
+    /// </summary>
+    /// <param name="name">直方图</param>
+    /// <param name="p">0 ~ 1</param>
+    uint64_t percentile(stats_histogram name, double p) const;
+
+    /// <summary>
+    /// 文本格式（每行 "名字 值"，直方图输出样本数和 p50/p99/max，便于采集）
+    /// </summary>
+    std::string to_string() const;
+
+    static const char* name(stats_counter name);
+    static const char* name(stats_histogram name);
+};
+
+/// <summary>
+/// 热路径统计
+/// 每个线程一份计数（只有本线程写入，relaxed 读改写不需要锁和原子加），
+/// collect 时累加所有线程和已退出线程的计数
+/// </summary>
+class package_stats final {
+public:
+    static constexpr bool enabled = PACKAGE_STATS != 0;
+    static constexpr uint32_t latency_sample = 16;      // 耗时每 16 次操作取 1 次（2 的幂）
+
+    struct thread_block {
+        std::atomic<uint64_t> _counters[package_stats_snapshot::counter_count] = {};
+        std::atomic<uint64_t> _buckets[package_stats_snapshot::histogram_count][package_stats_snapshot::bucket_count] = {};
+        uint32_t _sample_tick = 0;
+    };
+
+    static void add(stats_counter name, uint64_t value) {
+        bump(local()._counters[static_cast<uint32_t>(name)], value);
+    }
+
+    static void record(stats_histogram name, uint64_t value) {
+        bump(local()._buckets[static_cast<uint32_t>(name)][bucket(value)], 1);
+    }
+
+    /// <summary>
+    /// 抽样计时（析构时记录）
+    /// </summary>
+    class latency_timer final {
+    private:
+        stats_histogram _name;
+        bool _active;
+        std::chrono::steady_clock::time_point _begin;
+
+    public:
+        explicit latency_timer(stats_histogram name, bool active = true)
+            : _name(name)
+            , _active(active && (local()._sample_tick++ & (latency_sample - 1)) == 0) {
+            if (_active)
+                _begin = std::chrono::steady_clock::now();
+        }
+
+        ~latency_timer() {
+            if (_active) {
+                const auto elapsed = std::chrono::steady_clock::now() - _begin;
+                record(_name, static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()));
+            }
+        }
+
+        latency_timer(const latency_timer&) = delete;
+        latency_timer& operator = (const latency_timer&) = delete;
+    };
+
+    /// <summary>
+    /// 所有线程的统计快照（任意线程可调用）
+    /// </summary>
+    static package_stats_snapshot collect();
+
+    static uint32_t bucket(uint64_t value) {
+        const uint32_t result = util::bit_width64(value);
+        return result < package_stats_snapshot::bucket_count ? result : package_stats_snapshot::bucket_count - 1;
+    }
+
+private:
+    /// <summary>
+    /// 线程第一次统计时登记，退出时把计数并入已退出线程的合计
+    /// </summary>
+    struct thread_holder {
+        thread_block _block;
+        thread_holder();
+        ~thread_holder();
+    };
+
+    static thread_block* register_thread();
+
+    static thread_block& local() {
+        // 平凡初始化的指针不需要线程局部变量的初始化检查，热路径只有一次 TLS 读取
+        static thread_local thread_block* block = nullptr;
+        if (block == nullptr)
+            block = register_thread();
+        return *block;
+    }
+
+    static void bump(std::atomic<uint64_t>& value, uint64_t inc) {
+        value.store(value.load(std::memory_order_relaxed) + inc, std::memory_order_relaxed);
+    }
+};
+
+#if PACKAGE_STATS
+#define PACKAGE_STATS_ADD(name, value) package_stats::add(stats_counter::name, (value))
+#define PACKAGE_STATS_RECORD(name, value) package_stats::record(stats_histogram::name, (value))
+#define PACKAGE_STATS_LATENCY(name) package_stats::latency_timer _stats_latency_##name(stats_histogram::name)
+#define PACKAGE_STATS_LATENCY_IF(name, active) package_stats::latency_timer _stats_latency_##name(stats_histogram::name, (active))
+#else
+#define PACKAGE_STATS_ADD(name, value) ((void)0)
+#define PACKAGE_STATS_RECORD(name, value) ((void)0)
+#define PACKAGE_STATS_LATENCY(name) ((void)0)
+#define PACKAGE_STATS_LATENCY_IF(name, active) ((void)0)
+#endif
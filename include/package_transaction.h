@@ -0,0 +1,73 @@
+#pragma once
+#include <memory>
+#include <vector>
+
+#include "package.h"
+
+class object;
+
+/// <summary>
+/// 跨背包事务（同一个 object 的多个背包）
+/// 每个背包按需打开一个 package_operator，统一提交/回滚
+/// </summary>
+class package_transaction {
+private:
+    object* _owner = nullptr;                                   // 所属对象
+    std::vector<std::unique_ptr<package_operator>> _operators;  // 参与的背包操作
+
+public:
+    explicit package_transaction(object* owner);
+
+    virtual ~package_transaction();
+
+    // !! non copyable 
+    package_transaction() = delete;
+    package_transaction(const package_transaction&) = delete;
+    package_transaction& operator = (const package_transaction&) = delete;
+
+    /// <summary>
+    /// 获取背包的操作对象（首次使用时打开）
+    /// </summary>
+    /// <param name="package">背包（必须属于 owner）</param>
+    /// <returns>操作对象</returns>
+    package_operator& operator_of(package_ptr package);
+
+    /// <summary>
+    /// 背包间转移物品（整堆转移时沿用原物品对象）
+    /// </summary>
+    /// <param name="src">源背包</param>
+    /// <param name="src_slot">源格子</param>
+    /// <param name="dst">目标背包</param>
+    /// <param name="dst_slot">目标格子(无效格子表示由系统查找)</param>
+    /// <param name="count">数量</param>
+    /// <returns>转移了几个</returns>
+    uint32_t move(package_ptr src, slot_id src_slot, package_ptr dst, slot_id dst_slot, uint32_t count);
+
+    /// <summary>
+    /// 提交全部背包（任一背包没有取得写权限时全部回滚，不提交任何背包，见 conflicted()）
+    /// </summary>
+    /// <returns>自身引用，建议链式调用release</returns>
+    package_transaction& commit();
+
+    /// <summary>
+    /// 乐观提交全部背包：先检查所有背包的写权限和版本，任一冲突则全部回滚
+    /// </summary>
+    /// <returns>ok / conflict（所有背包的改动都已回滚，可重新读取后重试）</returns>
+    package_operator::commit_result try_commit();
+
+    /// <summary>
+    /// 是否有背包没有取得写权限（此时 commit 不会提交任何背包）
+    /// </summary>
+    bool conflicted() const;
+
+    /// <summary>
+    /// 回滚全部背包
+    /// </summary>
+    /// <returns>自身引用，建议链式调用release</returns>
+    package_transaction& rollback();
+
+    /// <summary>
+    /// 释放全部背包（未提交的改动回滚）
+    /// </summary>
+    void release();
+};
@@ -0,0 +1,71 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+#include "package.h"
+
+/// <summary>
+/// 背包只读视图（最后一次 commit 时的内容，创建后不再修改，可以在任意线程读取）
+/// 格子按 chunk_slots 分块，提交时只复制有改动的块，其余块与上一个视图共享
+/// </summary>
+class package_view final {
+public:
+    static constexpr uint32_t chunk_slots = 16;
+
+    struct chunk {
+        package_slot _slots[chunk_slots];
+    };
+
+private:
+    friend class package;
+
+    uint64_t _version = 0;                                  // 背包版本
+    uint32_t _capacity_cur = 0;                             // 当前容量
+    uint32_t _capacity_max = 0;                             // 最大容量
+    std::vector<std::shared_ptr<const chunk>> _chunks;      // 格子分块
+
+public:
+    uint64_t version() const {
+        return _version;
+    }
+
+    uint32_t capacity_cur() const {
+        return _capacity_cur;
+    }
+
+    uint32_t capacity_max() const {
+        return _capacity_max;
+    }
+
+    /// <summary>
+    /// 获取格子
+    /// </summary>
+    /// <param name="slot">格子index</param>
+    /// <returns>格子，超出当前容量为 nullptr</returns>
+    const package_slot* get_slot(slot_id slot) const {
+        if (slot >= _capacity_cur) return nullptr;
+        return &_chunks[slot / chunk_slots]->_slots[slot % chunk_slots];
+    }
+
+    /// <summary>
+    /// 遍历格子
+    /// </summary>
+    /// <param name="caller">caller(slot_id, const package_slot*)，返回 false 停止（break）</param>
+    template<typename _Fn>
+    void for_each_slot(_Fn&& caller) const {
+        for (slot_id one = 0; one < _capacity_cur; ++one) {
+            if (!caller(one, get_slot(one)))
+                break;
+        }
+    }
+
+    /// <summary>
+    /// 物品总数量
+    /// </summary>
+    /// <param name="goods_id">物品配置ID</param>
+    uint64_t count_of(uint32_t goods_id) const;
+};
+
+using package_view_ptr = std::shared_ptr<const package_view>;
@@ -0,0 +1,181 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+/// <summary>
+/// 小容量内联数组（N 个以内不分配堆内存，超出后扩到堆上）
+/// 只用于可平凡拷贝的类型（slot_id 之类）
+/// </summary>
+template<typename _Ty, uint32_t _Inline>
+class small_vector final {
+    static_assert(std::is_trivially_copyable<_Ty>::value, "small_vector only holds trivially copyable types");
+    static_assert(_Inline > 0, "small_vector needs inline capacity");
+
+private:
+    _Ty* _data = _inline;           // 当前数据（内联或堆）
+    uint32_t _size = 0;             // 数量
+    uint32_t _capacity = _Inline;   // 容量
+    _Ty _inline[_Inline];           // 内联存储
+
+public:
+    using value_type = _Ty;
+    using iterator = _Ty*;
+    using const_iterator = const _Ty*;
+
+    small_vector() = default;
+
+    small_vector(const small_vector& src) {
+        assign(src);
+    }
+
+    small_vector(small_vector&& src) noexcept {
+        steal(src);
+    }
+
+    ~small_vector() {
+        release();
+    }
+
+    small_vector& operator = (const small_vector& src) {
+        if (this != &src) {
+            _size = 0;
+            assign(src);
+        }
+        return *this;
+    }
+
+    small_vector& operator = (small_vector&& src) noexcept {
+        if (this != &src) {
+            release();
+            steal(src);
+        }
+        return *this;
+    }
+
+    uint32_t size() const { return _size; }
+    uint32_t capacity() const { return _capacity; }
+    bool empty() const { return _size == 0; }
+    bool is_inline() const { return _data == _inline; }
+
+    _Ty* data() { return _data; }
+    const _Ty* data() const { return _data; }
+
+    iterator begin() { return _data; }
+    iterator end() { return _data + _size; }
+    const_iterator begin() const { return _data; }
+    const_iterator end() const { return _data + _size; }
+
+    _Ty& operator[](uint32_t index) { return _data[index]; }
+    const _Ty& operator[](uint32_t index) const { return _data[index]; }
+
+    _Ty& front() { return _data[0]; }
+    const _Ty& front() const { return _data[0]; }
+    _Ty& back() { return _data[_size - 1]; }
+    const _Ty& back() const { return _data[_size - 1]; }
+
+    void clear() {
+        _size = 0;
+    }
+
+    void reserve(uint32_t capacity) {
+        if (capacity <= _capacity)
+            return;
+        _Ty* data = new _Ty[capacity];
+        std::memcpy(data, _data, sizeof(_Ty) * _size);
+        if (!is_inline())
+            delete[] _data;
+        _data = data;
+        _capacity = capacity;
+    }
+
+    void push_back(const _Ty& value) {
+        if (_size == _capacity)
+            reserve(_capacity * 2);
+        _data[_size++] = value;
+    }
+
+    void pop_back() {
+        --_size;
+    }
+
+    iterator insert(const_iterator pos, const _Ty& value) {
+        const auto index = static_cast<uint32_t>(pos - _data);
+        if (_size == _capacity)
+            reserve(_capacity * 2);
+        std::memmove(_data + index + 1, _data + index, sizeof(_Ty) * (_size - index));
+        _data[index] = value;
+        ++_size;
+        return _data + index;
+    }
+
+    iterator erase(const_iterator pos) {
+        const auto index = static_cast<uint32_t>(pos - _data);
+        std::memmove(_data + index, _data + index + 1, sizeof(_Ty) * (_size - index - 1));
+        --_size;
+        return _data + index;
+    }
+
+    /// <summary>
+    /// 有序插入（已存在则不插入）
+    /// </summary>
+    /// <returns>是否插入</returns>
+    bool insert_sorted(const _Ty& value) {
+        auto pos = std::lower_bound(begin(), end(), value);
+        if (pos != end() && !(value < *pos))
+            return false;
+        insert(pos, value);
+        return true;
+    }
+
+    /// <summary>
+    /// 有序删除
+    /// </summary>
+    /// <returns>是否删除</returns>
+    bool erase_sorted(const _Ty& value) {
+        auto pos = std::lower_bound(begin(), end(), value);
+        if (pos == end() || value < *pos)
+            return false;
+        erase(pos);
+        return true;
+    }
+
+    /// <summary>
+    /// 有序查找第一个不小于 value 的位置
+    /// </summary>
+    const_iterator lower_bound(const _Ty& value) const {
+        return std::lower_bound(begin(), end(), value);
+    }
+
+private:
+    void assign(const small_vector& src) {
+        reserve(src._size);
+        std::memcpy(_data, src._data, sizeof(_Ty) * src._size);
+        _size = src._size;
+    }
+
+    void steal(small_vector& src) {
+        if (src.is_inline()) {
+            _data = _inline;
+            _capacity = _Inline;
+            std::memcpy(_inline, src._inline, sizeof(_Ty) * src._size);
+        }
+        else {
+            _data = src._data;
+            _capacity = src._capacity;
+            src._data = src._inline;
+            src._capacity = _Inline;
+        }
+        _size = src._size;
+        src._size = 0;
+    }
+
+    void release() {
+        if (!is_inline())
+            delete[] _data;
+        _data = _inline;
+        _capacity = _Inline;
+        _size = 0;
+    }
+};
@@ -1,8 +1,15 @@
 #pragma once
+#include <array>
+#include <atomic>
 #include <chrono>
+#include <cstdint>
 #include <sstream>
 #include <string>
 
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
 namespace util {
 
     template<typename... _Args>
@@ -25,15 +32,157 @@ namespace util {
             ).count();
     }
 
+    /// <summary>
+    /// 最低位 1 的位置（bits != 0）
+    /// </summary>
+    inline uint32_t ctz64(uint64_t bits) {
+#if defined(_MSC_VER)
+        unsigned long index = 0;
+        _BitScanForward64(&index, bits);
+        return static_cast<uint32_t>(index);
+#else
+        return static_cast<uint32_t>(__builtin_ctzll(bits));
+#endif
+    }
+
+    /// <summary>
+    /// 表示 bits 需要的位数（最高位 1 的位置 + 1，bits == 0 时为 0）
+    /// </summary>
+    inline uint32_t bit_width64(uint64_t bits) {
+        if (bits == 0)
+            return 0;
+#if defined(_MSC_VER)
+        unsigned long index = 0;
+        _BitScanReverse64(&index, bits);
+        return static_cast<uint32_t>(index) + 1;
+#else
+        return 64 - static_cast<uint32_t>(__builtin_clzll(bits));
+#endif
+    }
+
+    /// <summary>
+    /// 1 的个数
+    /// </summary>
+    inline uint32_t popcount64(uint64_t bits) {
+#if defined(_MSC_VER)
+        return static_cast<uint32_t>(__popcnt64(bits));
+#else
+        return static_cast<uint32_t>(__builtin_popcountll(bits));
+#endif
+    }
+
+    /// <summary>
+    /// crc32 (IEEE 802.3)
+    /// </summary>
+    inline uint32_t crc32(const void* data, size_t size, uint32_t crc = 0) {
+        static const auto table = []() {
+            std::array<uint32_t, 256> result{};
+            for (uint32_t i = 0; i < 256; ++i) {
+                uint32_t value = i;
+                for (int bit = 0; bit < 8; ++bit) {
+                    value = (value & 1) ? (0xEDB88320u ^ (value >> 1)) : (value >> 1);
+                }
+                result[i] = value;
+            }
+            return result;
+        }();
+
+        const auto* bytes = static_cast<const uint8_t*>(data);
+        crc = ~crc;
+        for (size_t i = 0; i < size; ++i) {
+            crc = table[(crc ^ bytes[i]) & 0xFF] ^ (crc >> 8);
+        }
+        return ~crc;
+    }
+
+    /// <summary>
+    /// 带类型的时间序列号（毫秒 41 位 | 类型 5 位 | 序号 18 位），多线程安全
+    /// 同一毫秒内序号用完时借用下一毫秒，不回绕也不等待时钟；时钟回拨时沿用上一次的毫秒
+    /// </summary>
+    /// <param name="type">类型（0 ~ 31）</param>
     inline uint64_t sequence_faster(uint8_t type) {
         static constexpr uint64_t _spot = 1672502400000ull;     // 2023-01-01
-        static constexpr uint64_t _sequence_max = 0x3FFFFull;
-        static uint64_t _sequence = 0;
-        const uint64_t mill_now = ticks<std::chrono::milliseconds>();
-        const uint64_t mill_end = mill_now - _spot;
-        _sequence += 1;
-        _sequence >= _sequence_max ? _sequence = 0 : _sequence;
-        return ((mill_end << 23) | (type << 18) | (_sequence & _sequence_max));
+        static constexpr uint64_t _sequence_bits = 18;
+        static constexpr uint64_t _sequence_max = (1ull << _sequence_bits) - 1;
+        static constexpr uint64_t _type_max = 0x1Full;
+        static std::atomic<uint64_t> _last{ 0 };                // 毫秒 << 18 | 序号
+
+        const uint64_t mill_now = ticks<std::chrono::milliseconds, std::chrono::system_clock>();
+        const uint64_t now = (mill_now > _spot ? mill_now - _spot : 0) << _sequence_bits;
+        uint64_t last = _last.load(std::memory_order_relaxed);
+        uint64_t next = 0;
+        do {
+            next = last + 1 > now ? last + 1 : now;
+        } while (!_last.compare_exchange_weak(last, next, std::memory_order_relaxed));
+
+        const uint64_t mill_end = next >> _sequence_bits;
+        return (mill_end << 23) | ((type & _type_max) << 18) | (next & _sequence_max);
     }
 
+    /// <summary>
+    /// 全局唯一ID（节点 10 位 | 计数 54 位），无锁
+    /// 每个线程从全局计数一次领取 block_size 个ID，之后在线程内递增，只有领取时才有一次原子操作；
+    /// 计数从 (启动时的毫秒 - 2023-01-01) << 14 开始，只要平均每毫秒用不完 16384 个，重启后也不会与之前重复
+    /// </summary>
+    class id_generator final {
+    public:
+        static constexpr uint32_t node_bits = 10;
+        static constexpr uint32_t node_max = (1u << node_bits) - 1;
+        static constexpr uint32_t counter_bits = 64 - node_bits;
+        static constexpr uint64_t counter_mask = (1ull << counter_bits) - 1;
+        static constexpr uint32_t tick_bits = 14;
+        static constexpr uint64_t block_size = 4096;
+
+        /// <summary>
+        /// 设置节点ID（每个进程/服务器唯一，启动时设置）
+        /// </summary>
+        static void node(uint32_t node_id) {
+            node_value().store(node_id & node_max, std::memory_order_relaxed);
+        }
+
+        static uint32_t node() {
+            return node_value().load(std::memory_order_relaxed);
+        }
+
+        /// <summary>
+        /// 下一个ID（不为 0）
+        /// </summary>
+        static uint64_t next() {
+            auto& block = local_block();
+            if (block._next == block._end)
+                refill(block);
+            return (static_cast<uint64_t>(node()) << counter_bits) | (block._next++ & counter_mask);
+        }
+
+    private:
+        struct block_info {
+            uint64_t _next = 0;     // 下一个计数
+            uint64_t _end = 0;      // 本块结束（不含）
+        };
+
+        static block_info& local_block() {
+            static thread_local block_info block;
+            return block;
+        }
+
+        static std::atomic<uint32_t>& node_value() {
+            static std::atomic<uint32_t> value{ 0 };
+            return value;
+        }
+
+        static std::atomic<uint64_t>& counter() {
+            static constexpr uint64_t _spot = 1672502400000ull;     // 2023-01-01
+            static std::atomic<uint64_t> value{ []() {
+                const uint64_t mill_now = ticks<std::chrono::milliseconds, std::chrono::system_clock>();
+                return ((mill_now > _spot ? mill_now - _spot : 0) << tick_bits) + 1;
+            }() };
+            return value;
+        }
+
+        static void refill(block_info& block) {
+            block._next = counter().fetch_add(block_size, std::memory_order_relaxed);
+            block._end = block._next + block_size;
+        }
+    };
+
 }; // end namespace util
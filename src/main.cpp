@@ -1,12 +1,84 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <cassert>
+#include <cstdio>
+#include <cstdlib>
 #include <iostream>
+#include <new>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
 
+#include "binary_stream.h"
 #include "goods.h"
 #include "goods_type_enum.h"
 #include "object.h"
 #include "package.h"
+#include "package_dedup.h"
+#include "package_journal.h"
+#include "package_service.h"
+#include "package_snapshot.h"
+#include "package_stats.h"
+#include "package_transaction.h"
+#include "package_view.h"
 #include "util.h"
 
+// 全局堆分配计数
+static std::atomic<uint64_t> g_alloc_count{ 0 };
+
+void* operator new(size_t size) {
+    ++g_alloc_count;
+    if (void* ptr = std::malloc(size ? size : 1))
+        return ptr;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+    std::free(ptr);
+}
+
+void* operator new(size_t size, std::align_val_t align) {
+    ++g_alloc_count;
+    const auto alignment = std::max(static_cast<size_t>(align), sizeof(void*));
+    if (void* ptr = std::aligned_alloc(alignment, (std::max<size_t>(size, 1) + alignment - 1) / alignment * alignment))
+        return ptr;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* ptr, std::align_val_t) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, size_t, std::align_val_t) noexcept {
+    std::free(ptr);
+}
+
+class delta_collector : public package_notify_sink {
+public:
+    std::vector<std::string> _messages;
+
+    void on_package_delta(package*, const std::string& message) override {
+        _messages.emplace_back(message);
+    }
+};
+
+class counting_sink : public package_notify_sink {
+public:
+    uint64_t _messages = 0;
+    bool _throw = false;
+
+    void on_package_delta(package*, const std::string&) override {
+        ++_messages;
+        if (_throw)
+            throw std::runtime_error("sink failed");
+    }
+};
+
 int main(int argc, char* argv[]) {
 
     auto uuid = [](uint32_t src) -> uint64_t {
@@ -27,6 +99,11 @@ int main(int argc, char* argv[]) {
         {8, goods::create(uuid(8), 8, goods_type_enum::item, 99)},
         {9, goods::create(uuid(9), 9, goods_type_enum::item, 99)},
     };
+    // 配置加载完成：登记共享道具后冻结注册表
+    for (const auto& iter : __goods) {
+        goods_registry::instance().intern(iter.second);
+    }
+    goods_registry::instance().freeze();
 
     auto slot_cout = [](slot_id slot, package_slot* pSlot) -> bool {
         if (slot % 5 == 0)
@@ -95,14 +172,13 @@ int main(int argc, char* argv[]) {
 
     {
         // from normal package to store
-        package_operator op_nor(pUser_1001->normal_package());
-        package_operator op_sto(pUser_1001->store_package());
+        package_transaction trans(pUser_1001);
 
         auto nor_slot_ptr = pUser_1001->normal_package()->get_slot(0);
         assert(nor_slot_ptr != nullptr && !nor_slot_ptr->empty());
         auto backup_slot = *nor_slot_ptr;
-        op_nor.rem(nor_slot_ptr->_goods->id(), nor_slot_ptr->_count, 0);
-        op_sto.put(backup_slot._goods, backup_slot._count, 1);
+        assert(trans.move(pUser_1001->normal_package(), 0, pUser_1001->store_package(), 1, backup_slot._count) == backup_slot._count);
+        assert(pUser_1001->store_package()->get_slot(1)->_goods == backup_slot._goods);
 
         std::cout << std::endl << "----------------------------------------------" << std::endl;
         pUser_1001->normal_package()->for_each_slot(slot_cout);
@@ -112,8 +188,7 @@ int main(int argc, char* argv[]) {
         pUser_1001->store_package()->for_each_slot(slot_cout);
         std::cout << pUser_1001->store_package()->empty_slot_next() << ":" << pUser_1001->store_package()->empty_slot_count() << std::endl;
 
-        op_nor.commit();
-        op_sto.commit();
+        trans.commit();
     }
 
     std::cout << std::endl << "----------------------------------------------" << std::endl;
@@ -124,5 +199,869 @@ int main(int argc, char* argv[]) {
     pUser_1001->store_package()->for_each_slot(slot_cout);
     std::cout << pUser_1001->store_package()->empty_slot_next() << ":" << pUser_1001->store_package()->empty_slot_count() << std::endl;
 
+    {
+        // rollback 只撤销本次事务的改动
+        auto pPackage = pUser_1001->normal_package();
+        const auto empty_count = pPackage->empty_slot_count();
+        const auto slot_1 = *pPackage->get_slot(1);
+
+        package_operator op(pPackage);
+        assert(op.put(__goods[3], 10) == 10);
+        assert(op.rem(1, 1) == 1);
+        op.rollback();
+
+        assert(pPackage->empty_slot_count() == empty_count);
+        assert(pPackage->get_slot(1)->_count == slot_1._count);
+        assert(op.rem(3, 10) == 0);
+        assert(op.rem(1, 1) == 1);
+        op.rollback().release();
+    }
+
+    {
+        // savepoint 部分回滚
+        auto pPackage = pUser_1001->store_package();
+        pPackage->re_init();
+        const auto empty_count = pPackage->empty_slot_count();
+
+        package_operator op(pPackage);
+        assert(op.put(__goods[4], 10) == 10);
+        auto sp1 = op.savepoint();
+        assert(op.put(__goods[4], 200) == 200);
+        auto sp2 = op.savepoint();
+        assert(op.put(__goods[5], 1) == 1);
+        assert(op.rollback_to(sp2));
+        assert(op.rem(5, 1) == 0);
+        assert(op.rollback_to(sp1));
+        assert(!op.rollback_to(sp2));
+        assert(pPackage->empty_slot_count() == empty_count - 1);
+        assert(op.rem(4, 100) == 10);
+        assert(op.release_savepoint(sp1));
+        op.rollback();
+        assert(pPackage->empty_slot_count() == empty_count);
+        op.release();
+    }
+
+    {
+        // 跨背包事务：任一背包冲突时全部不提交
+        object player(3001);
+        auto normal = player.normal_package();
+        auto store = player.store_package();
+        {
+            package_operator op(normal);
+            assert(op.put(__goods[3], 20, 0) == 20);
+            op.commit().release();
+        }
+        {
+            package_transaction trans(&player);
+            assert(trans.move(normal, 0, store, INVALID_SLOT, 5) == 5);
+            trans.operator_of(store).expect_version(store->version() - 1);     // 读取之后背包被修改
+            assert(trans.try_commit() == package_operator::commit_result::conflict);
+            assert(normal->count_of(3) == 20 && store->count_of(3) == 0);
+
+            assert(trans.move(normal, 0, store, INVALID_SLOT, 5) == 5);
+            assert(trans.try_commit() == package_operator::commit_result::ok);
+            trans.release();
+        }
+        assert(normal->count_of(3) == 15 && store->count_of(3) == 5);
+        {
+            package_operator holder(store);
+            package_transaction trans(&player);
+            assert(trans.operator_of(normal).put(__goods[3], 10) == 10);
+            assert(trans.move(normal, 0, store, INVALID_SLOT, 5) == 0);
+            assert(trans.conflicted());
+            trans.commit().release();
+            assert(trans.try_commit() == package_operator::commit_result::ok);     // 已释放，没有参与者
+        }
+        assert(normal->count_of(3) == 15 && store->count_of(3) == 5);
+    }
+
+    {
+        // 已提交的变更不会被之后的回滚/释放丢掉
+        delta_collector collector;
+        package bag(nullptr, package_type_enum::store, 10);
+        bag.capacity_cur(5);
+        bag.notify_sink(&collector);
+
+        package_type_enum type;
+        uint32_t capacity = 0;
+        std::vector<slot_delta> deltas;
+        {
+            package_operator op(&bag);
+            assert(op.put(__goods[3], 10, 0) == 10);
+            op.commit();
+            assert(op.put(__goods[3], 10, 1) == 10);
+            op.notify();                                    // 未提交的不通知
+            assert(collector._messages.size() == 1);
+            assert(decode_slot_delta(collector._messages[0].data(), collector._messages[0].size(), type, capacity, deltas));
+            assert(deltas.size() == 1 && deltas[0]._slot == 0);
+
+            op.commit();
+            auto sp = op.savepoint();
+            assert(op.put(__goods[3], 10, 2) == 10);
+            assert(op.rollback_to(sp) && op.put(__goods[3], 10, 2) == 10);
+            op.commit();
+            assert(op.put(__goods[3], 10, 3) == 10);
+            op.rollback();                                  // 已提交的 slot 1/2 保留
+            op.notify();
+            assert(collector._messages.size() == 2);
+            assert(decode_slot_delta(collector._messages[1].data(), collector._messages[1].size(), type, capacity, deltas));
+            assert(deltas.size() == 2 && deltas[0]._slot == 1 && deltas[1]._slot == 2);
+
+            assert(op.rem(3, 5, 0) == 5);
+            op.commit();
+            assert(op.rem(3, 5, 1) == 5);
+        }                                                   // 释放时通知已提交未通知的部分
+        assert(collector._messages.size() == 3);
+        assert(decode_slot_delta(collector._messages[2].data(), collector._messages[2].size(), type, capacity, deltas));
+        assert(deltas.size() == 1 && deltas[0]._slot == 0 && deltas[0]._count == 5);
+        assert(bag.count_of(3) == 25);
+    }
+
+    {
+        // 批量添加复用同一批里前面的组留下的未满堆叠
+        auto big = goods::create(uuid(40), 40, goods_type_enum::item, 20);
+        auto small = goods::create(uuid(30), 30, goods_type_enum::item, 5);
+        const std::vector<put_entry> entries = { { big, 25, false }, { big, 15 }, { small, 5 } };
+
+        package bag(nullptr, package_type_enum::store, 10);
+        bag.capacity_cur(3);
+        assert(bag.can_put_all(entries));
+
+        std::vector<uint32_t> placed;
+        package_operator op(&bag);
+        assert(op.put_many(entries, &placed) == 45);
+        assert(placed[0] == 25 && placed[1] == 15 && placed[2] == 5);
+        assert(bag.count_of(40) == 40 && bag.count_of(30) == 5 && bag.empty_slot_count() == 0);
+        op.rollback();
+
+        uint32_t sequential = 0;
+        for (const auto& entry : entries) {
+            sequential += op.put(entry._goods, entry._count, INVALID_SLOT, entry._overlap);
+        }
+        assert(sequential == 45);
+        op.rollback().release();
+    }
+
+    {
+        // 保存点回滚后，保存点之前改动过的格子仍要提交（标脏、写日志、递增版本、发布视图）
+        const std::string path = "package_savepoint_test.log";
+        std::remove(path.c_str());
+        package_journal journal;
+        assert(journal.open(path));
+
+        package bag(nullptr, package_type_enum::store, 20);
+        bag.capacity_cur(10);
+        bag.enable_view(true);
+        bag.journal(&journal);
+        std::vector<slot_id> dirty;
+        bag.collect_dirty(dirty);
+        const uint64_t version = bag.version();
+        {
+            package_operator op(&bag);
+            assert(op.put(__goods[3], 10, 2) == 10);
+            auto sp = op.savepoint();
+            assert(op.put(__goods[3], 5, 2) == 5);
+            assert(op.rollback_to(sp));
+            op.commit().release();
+        }
+        assert(bag.version() == version + 1);
+        assert(!bag.collect_dirty(dirty) && dirty == std::vector<slot_id>{ 2 });
+        assert(bag.view()->get_slot(2)->_count == 10);
+        journal.close();
+
+        package restored(nullptr, package_type_enum::store, 20);
+        restored.capacity_cur(10);
+        assert(package_journal::replay(path, &restored) == 1);
+        assert(restored.get_slot(2)->_count == 10 && restored.count_of(3) == 10);
+        std::remove(path.c_str());
+    }
+
+    {
+        // 空格子位图跨 64 位
+        package bag(nullptr, package_type_enum::store, 200);
+        bag.capacity_cur(130);
+        assert(bag.empty_slot_count() == 130);
+
+        package_operator op(&bag);
+        assert(op.put(__goods[2], 100) == 100);
+        assert(bag.empty_slot_count() == 30);
+        assert(bag.get_empty_slot_id() == 100);
+        assert(op.rem(2, 1, 70) == 1);
+        assert(bag.get_empty_slot_id() == 70);
+        assert(bag.first_empty_slot(71) == 100);
+        assert(op.aug(10));
+        assert(bag.empty_slot_count() == 41);
+        op.rollback();
+        assert(bag.empty_slot_count() == 130);
+        assert(bag.capacity_cur() == 130);
+
+        // 未满堆叠
+        assert(op.put(__goods[6], 150) == 150);
+        assert(bag.stack_room(6) == 48);
+
+        // 容量预检查
+        std::vector<uint32_t> placed;
+        assert(bag.can_put_all({ { __goods[6], 48 + 99 * 128 } }));
+        assert(!bag.can_put_all({ { __goods[6], 48 + 99 * 128 + 1 } }, &placed));
+        assert(placed[0] == 48 + 99 * 128);
+        assert(bag.can_put_all({ { __goods[7], 50 }, { __goods[7], 49 }, { __goods[2], 127 } }));
+        assert(!bag.can_put_all({ { __goods[7], 50, false }, { __goods[7], 49 }, { __goods[2], 128 } }, &placed));
+        assert(placed[0] == 50 && placed[1] == 49 && placed[2] == 127);
+        assert(bag.empty_slot_count() == 128);
+
+        // 批量
+        auto sp = op.savepoint();
+        assert(op.put_many({ { __goods[7], 50 }, { __goods[6], 48 }, { __goods[7], 60 }, { __goods[2], 3 } }, &placed) == 161);
+        assert(placed[0] == 50 && placed[1] == 48 && placed[2] == 60 && placed[3] == 3);
+        assert(bag.stack_room(6) == 0 && bag.stack_room(7) == 88);
+        assert(bag.empty_slot_count() == 128 - 5);
+        assert(bag.count_of(7) == 110 && bag.count_of(6) == 198);
+        assert(op.rem_many({ { 7, 100 }, { 6, 1 }, { 8, 1 } }, &placed, true) == 0);
+        assert(bag.count_of(7) == 110);
+        assert(op.rem(7, 111, INVALID_SLOT, true) == 0);
+        assert(op.rem_many({ { 7, 100 }, { 6, 1 }, { 8, 1 } }, &placed) == 101);
+        assert(bag.count_of(7) == 10 && bag.count_of(6) == 197 && bag.count_of(8) == 0);
+        assert(placed[0] == 100 && placed[1] == 1 && placed[2] == 0);
+        assert(op.rollback_to(sp));
+        assert(bag.empty_slot_count() == 128);
+
+        assert(op.put(__goods[6], 50, 5) == 50);
+        assert(bag.stack_room(6) == 48 + 49);
+        assert(op.put(__goods[6], 97) == 97);
+        assert(bag.stack_room(6) == 0);
+        op.rollback();
+        assert(bag.stack_room(6) == 0);
+        assert(bag.empty_slot_count() == 130);
+
+        // 合并通知
+        delta_collector collector;
+        assert(op.put(__goods[6], 150) == 150);
+        op.commit();
+        op.notify();
+        bag.notify_sink(&collector);
+        assert(op.put(__goods[6], 10) == 10);
+        assert(op.put(__goods[6], 40) == 40);
+        assert(op.rem(6, 99, 0) == 99);
+        assert(op.swp(0, 1));
+        op.commit();
+        op.notify();
+        assert(collector._messages.size() == 1);
+
+        package_type_enum type;
+        uint32_t capacity = 0;
+        std::vector<slot_delta> deltas;
+        assert(decode_slot_delta(collector._messages[0].data(), collector._messages[0].size(), type, capacity, deltas));
+        assert(type == package_type_enum::store && capacity == 130 && deltas.size() == 3);
+        assert(deltas[0]._slot == 0 && deltas[0]._goods_id == 6 && deltas[0]._count == 99);
+        assert(deltas[1]._slot == 1 && deltas[1]._count == 0);
+        assert(deltas[2]._slot == 2 && deltas[2]._goods_id == 6 && deltas[2]._count == 2);
+        bag.notify_sink(nullptr);
+        op.release();
+    }
+
+    {
+        // 预热后的小事务不分配堆内存
+        package bag(nullptr, package_type_enum::store, 100);
+        bag.capacity_cur(100);
+
+        auto transaction = [&bag, &__goods]() {
+            package_operator op(&bag);
+            assert(op.put(__goods[3], 120) == 120);
+            assert(op.put(__goods[4], 1) == 1);
+            assert(op.rem(3, 20) == 20);
+            assert(op.swp(0, 5));
+            op.rollback();
+            assert(op.put(__goods[5], 10) == 10);
+            assert(op.rem(5, 10) == 10);
+            op.commit().release();
+        };
+        transaction();
+        transaction();
+
+        const uint64_t alloc_count = g_alloc_count;
+        for (int i = 0; i < 100; ++i) {
+            transaction();
+        }
+        assert(g_alloc_count == alloc_count);
+    }
+
+    {
+        // 挂了通知接收者时提交 + 通知也不分配；接收者抛出异常时 release 不向外抛
+        package bag(nullptr, package_type_enum::store, 100);
+        bag.capacity_cur(40);
+        counting_sink sink;
+        bag.notify_sink(&sink);
+        auto transaction = [&bag, &__goods]() {
+            package_operator op(&bag);
+            assert(op.put(__goods[3], 120) == 120);
+            assert(op.rem(3, 20) == 20);
+            op.commit();
+            assert(op.rem(3, 100) == 100);
+            op.commit().release();
+        };
+        transaction();
+        transaction();
+
+        const uint64_t alloc_count = g_alloc_count;
+        for (int i = 0; i < 100; ++i) {
+            transaction();
+        }
+        assert(g_alloc_count == alloc_count);
+        assert(sink._messages == 102);
+
+        const uint64_t failures = package_stats::collect().counter(stats_counter::notify_failures);
+        sink._throw = true;
+        transaction();
+        assert(sink._messages == 103 && bag.count_of(3) == 0);
+        assert(!package_stats::enabled || package_stats::collect().counter(stats_counter::notify_failures) == failures + 1);
+    }
+
+    {
+        // 提交日志重放
+        const std::string path = "package_journal_test.log";
+        std::remove(path.c_str());
+
+        object player(2001);
+        package_journal journal;
+        assert(journal.open(path));
+        player.normal_package()->journal(&journal);
+        {
+            package_operator op(player.normal_package());
+            assert(op.put(__goods[3], 150) == 150);
+            assert(op.put(__goods[2], 1, 5) == 1);
+            op.commit();
+            assert(op.rem(3, 60) == 60);
+            assert(op.swp(0, 7));
+            op.commit();
+            assert(op.put(__goods[4], 10) == 10);
+            op.rollback();
+            assert(op.aug(20));
+            op.commit().release();
+        }
+        assert(player.normal_package()->journal_seq() == 3);
+        journal.close();
+        assert(journal.append_count() == 3);
+
+        object restored(2001);
+        assert(package_journal::replay(path, restored.normal_package()) == 3);
+        assert(package_journal::replay(path, restored.store_package()) == 0);
+        assert(restored.normal_package()->journal_seq() == 3);
+        assert(restored.normal_package()->capacity_cur() == 30);
+        for (slot_id slot = 0; slot < 30; ++slot) {
+            auto* pSrc = player.normal_package()->get_slot(slot);
+            auto* pDst = restored.normal_package()->get_slot(slot);
+            assert(pSrc->_count == pDst->_count);
+            assert(!pSrc->_goods == !pDst->_goods);
+            assert(!pSrc->_goods || pSrc->_goods->id() == pDst->_goods->id());
+        }
+        assert(restored.normal_package()->count_of(3) == 90);
+        assert(restored.normal_package()->empty_slot_count() == 27);
+
+        // 已重放的记录不会重复应用
+        assert(package_journal::replay(path, restored.normal_package()) == 0);
+
+        // 一次扫描加载多个背包
+        package_journal::replay_index index;
+        assert(index.load(path) && index.size() == 3);
+        object again(2001);
+        assert(index.apply(again.normal_package()) == 3 && index.apply(again.store_package()) == 0);
+        assert(again.normal_package()->count_of(3) == 90 && again.normal_package()->journal_seq() == 3);
+        std::remove(path.c_str());
+    }
+
+    {
+        // 记录校验失败时整条不应用（不会只写入一部分格子）
+        const std::string path = "package_journal_partial.log";
+        std::remove(path.c_str());
+        package big(nullptr, package_type_enum::store, 200);
+        big.capacity_cur(200);
+        package_journal journal;
+        assert(journal.open(path));
+        big.journal(&journal);
+        {
+            package_operator op(&big);
+            assert(op.put(__goods[3], 1, 0) == 1);
+            assert(op.put(__goods[3], 1, 150) == 1);
+            op.commit().release();
+        }
+        big.journal(nullptr);
+        journal.close();
+
+        package small(nullptr, package_type_enum::store, 100);
+        small.capacity_cur(50);
+        assert(package_journal::replay(path, &small) == 0);
+        assert(small.count_of(3) == 0 && small.journal_seq() == 0 && small.capacity_cur() == 50);
+        std::remove(path.c_str());
+    }
+
+#if !defined(_MSC_VER)
+    {
+        // 日志写入失败：之后的记录都被拒绝，journal_seq 不推进
+        object player(2002);
+        package_journal journal;
+        if (journal.open("/dev/full")) {
+            player.normal_package()->journal(&journal);
+            package_operator op(player.normal_package());
+            assert(op.put(__goods[3], 10) == 10);
+            op.commit();
+            assert(journal.failed());
+            assert(player.normal_package()->journal_seq() == 0);
+            assert(!journal.append("x") && !journal.flush());
+            assert(op.put(__goods[3], 10) == 10);
+            op.commit().release();
+            assert(player.normal_package()->journal_seq() == 0);
+            assert(player.normal_package()->count_of(3) == 20);
+            player.normal_package()->journal(nullptr);
+            journal.close();
+        }
+    }
+#endif
+
+    {
+        // 快照
+        package bag(nullptr, package_type_enum::store, 200);
+        bag.capacity_cur(150);
+        {
+            package_operator op(&bag);
+            assert(op.put(__goods[3], 250) == 250);
+            assert(op.put(__goods[2], 1, 40) == 1);
+            assert(op.put(goods::create(uuid(10), 10, goods_type_enum::equip, 1), 1, 120) == 1);
+            assert(op.rem(3, 50, 1) == 50);
+            op.commit().release();
+        }
+        bag.journal_seq(7);
+
+        binary_writer writer;
+        package_snapshot::save(&bag, writer);
+
+        package loaded(nullptr, package_type_enum::store, 200);
+        assert(package_snapshot::load(writer.buffer(), &loaded));
+        assert(loaded.capacity_cur() == 150 && loaded.journal_seq() == 7);
+        assert(loaded.empty_slot_count() == bag.empty_slot_count());
+        assert(loaded.count_of(3) == 200 && loaded.count_of(2) == 1 && loaded.count_of(10) == 1);
+        assert(loaded.stack_room(3) == bag.stack_room(3));
+        assert(loaded.get_slot(120)->_goods->uuid() == uuid(10));
+        assert(loaded.first_empty_slot(0) == bag.first_empty_slot(0));
+
+        // 不完整的快照不改变背包
+        assert(!package_snapshot::load(writer.buffer().data(), writer.size() - 1, &loaded));
+        assert(loaded.count_of(3) == 200);
+        package other(nullptr, package_type_enum::normal, 200);
+        assert(!package_snapshot::load(writer.buffer(), &other));
+    }
+
+    {
+        // 增量保存
+        package bag(nullptr, package_type_enum::store, 200);
+        bag.capacity_cur(100);
+        std::vector<slot_id> dirty;
+        {
+            package_operator op(&bag);
+            assert(op.put(__goods[3], 120) == 120);
+            op.rollback();
+            op.commit();
+            assert(!bag.dirty());
+
+            assert(op.put(__goods[3], 120) == 120);
+            assert(op.put(__goods[2], 1, 70) == 1);
+            op.commit();
+            assert(bag.dirty_count() == 3);
+            assert(!bag.collect_dirty(dirty));
+            assert(dirty.size() == 3 && dirty[0] == 0 && dirty[1] == 1 && dirty[2] == 70);
+            assert(!bag.dirty());
+
+            assert(op.swp(1, 150) == false);
+            assert(op.aug(60));
+            assert(op.swp(1, 150));
+            op.commit().release();
+        }
+        assert(bag.collect_dirty(dirty));
+        assert(dirty.size() == 2 && dirty[0] == 1 && dirty[1] == 150);
+        assert(!bag.collect_dirty(dirty) && dirty.empty());
+    }
+
+    {
+        // 整理
+        package bag(nullptr, package_type_enum::store, 200);
+        bag.capacity_cur(20);
+        {
+            package_operator op(&bag);
+            assert(op.put(__goods[3], 50, 4, false) == 50);
+            assert(op.put(__goods[3], 30, 9, false) == 30);
+            assert(op.put(__goods[3], 40, 12, false) == 40);
+            assert(op.put(goods::create(uuid(10), 10, goods_type_enum::equip, 1), 1, 2) == 1);
+            assert(op.put(__goods[2], 1, 0) == 1);
+            assert(op.put(__goods[5], 10, 15, false) == 10);
+            op.commit().release();
+        }
+
+        delta_collector collector;
+        bag.notify_sink(&collector);
+        std::vector<slot_id> changed;
+        bag.auto_pack(pack_order(), &changed);
+        assert((changed == std::vector<slot_id>{ 1, 2, 3, 4, 9, 12, 15 }));
+        assert(bag.get_slot(0)->same(2) && bag.get_slot(0)->_count == 1);
+        assert(bag.get_slot(1)->same(3) && bag.get_slot(1)->_count == 99);
+        assert(bag.get_slot(2)->same(3) && bag.get_slot(2)->_count == 21);
+        assert(bag.get_slot(3)->same(5) && bag.get_slot(3)->_count == 10);
+        assert(bag.get_slot(4)->same(10) && bag.get_slot(4)->_goods->uuid() == uuid(10));
+        assert(bag.empty_slot_count() == 15 && bag.count_of(3) == 120 && bag.stack_room(3) == 78);
+        assert(collector._messages.size() == 1);
+
+        bag.auto_pack(pack_order(), &changed);
+        assert(changed.empty());
+
+        bag.auto_pack(pack_order{ { pack_key::count, pack_key::id, pack_key::id } }, &changed);
+        assert((changed == std::vector<slot_id>{ 1, 2, 3, 4 }));
+        assert(bag.get_slot(1)->same(10));
+        assert(bag.get_slot(4)->same(3) && bag.get_slot(4)->_count == 99);
+        bag.notify_sink(nullptr);
+
+        // 遍历
+        std::vector<slot_id> slots;
+        for (auto entry : bag.occupied_slots()) {
+            slots.push_back(entry._slot);
+        }
+        assert((slots == std::vector<slot_id>{ 0, 1, 2, 3, 4 }));
+        slots.clear();
+        for (auto [slot, pSlot] : bag.slots_of(3)) {
+            assert(pSlot->same(3));
+            slots.push_back(slot);
+        }
+        assert((slots == std::vector<slot_id>{ 3, 4 }));
+        slots.clear();
+        for (auto entry : bag.slots_of_type(goods_type_enum::equip)) {
+            slots.push_back(entry._slot);
+        }
+        assert((slots == std::vector<slot_id>{ 1 }));
+        assert(bag.slots_of(9).begin() == bag.slots_of(9).end());
+
+        uint32_t visited = 0;
+        bag.for_each_slot([&visited](package_slot*) { ++visited; });
+        assert(visited == 20);
+        std::function<bool(slot_id, package_slot*)> stop_at_empty = [](slot_id, package_slot* pSlot) { return !pSlot->empty(); };
+        visited = 0;
+        bag.for_each_slot(2, [&visited, &stop_at_empty](slot_id slot, package_slot* pSlot) {
+            return stop_at_empty(slot, pSlot) && ++visited;
+        });
+        assert(visited == 3);
+    }
+
+    {
+        // 版本 & 冲突
+        package bag(nullptr, package_type_enum::store, 100);
+        bag.capacity_cur(50);
+        const uint64_t version = bag.version();
+        {
+            package_operator op(&bag);
+            package_operator other(&bag);
+            assert(!op.conflicted() && other.conflicted());
+            assert(other.put(__goods[3], 10) == 0 && !other.swp(0, 1) && !other.aug(1));
+            assert(other.try_commit() == package_operator::commit_result::conflict);
+            other.release();
+
+            op.commit();
+            assert(bag.version() == version);       // 没有改动不递增
+            assert(op.put(__goods[3], 10) == 10);
+            assert(op.try_commit() == package_operator::commit_result::ok);
+            assert(bag.version() == version + 1);
+            op.release();
+        }
+
+        // 读-算-写：读取之后背包被修改则冲突
+        const uint64_t read_version = bag.version();
+        const bool enough = bag.count_of(3) >= 10;
+        {
+            package_operator op(&bag);
+            assert(op.rem(3, 5) == 5);
+            op.commit().release();
+        }
+        {
+            package_operator op(&bag);
+            op.expect_version(read_version);
+            assert(enough && op.rem(3, 10) == 5);
+            assert(op.try_commit() == package_operator::commit_result::conflict);
+            assert(bag.count_of(3) == 5);
+
+            // 重新读取后重试
+            op.expect_version(bag.version());
+            assert(op.rem(3, 5) == 5);
+            assert(op.try_commit() == package_operator::commit_result::ok);
+            op.release();
+        }
+        assert(bag.count_of(3) == 0 && bag.version() == read_version + 2);
+    }
+
+    {
+        // 唯一ID
+        util::id_generator::node(5);
+        std::vector<uint64_t> ids;
+        std::vector<uint64_t> sequences;
+        std::vector<std::thread> threads;
+        std::vector<std::vector<uint64_t>> thread_ids(4);
+        std::vector<std::vector<uint64_t>> thread_sequences(4);
+        for (size_t i = 0; i < thread_ids.size(); ++i) {
+            threads.emplace_back([&thread_ids, &thread_sequences, i]() {
+                for (int n = 0; n < 100000; ++n) {
+                    thread_ids[i].emplace_back(util::id_generator::next());
+                    thread_sequences[i].emplace_back(util::sequence_faster(3));
+                }
+            });
+        }
+        for (size_t i = 0; i < threads.size(); ++i) {
+            threads[i].join();
+            assert(std::is_sorted(thread_ids[i].begin(), thread_ids[i].end()));
+            assert(std::is_sorted(thread_sequences[i].begin(), thread_sequences[i].end()));
+            ids.insert(ids.end(), thread_ids[i].begin(), thread_ids[i].end());
+            sequences.insert(sequences.end(), thread_sequences[i].begin(), thread_sequences[i].end());
+        }
+        std::sort(ids.begin(), ids.end());
+        std::sort(sequences.begin(), sequences.end());
+        assert(std::adjacent_find(ids.begin(), ids.end()) == ids.end());
+        assert(std::adjacent_find(sequences.begin(), sequences.end()) == sequences.end());
+        assert(ids.front() >> util::id_generator::counter_bits == 5);
+        assert(((sequences.front() >> 18) & 0x1F) == 3);
+
+        package bag(nullptr, package_type_enum::store, 10);
+        uint64_t last = 0;
+        for (int i = 0; i < 3; ++i) {
+            package_operator op(&bag);
+            assert(op.transaction_id() != 0 && op.transaction_id() != last);
+            last = op.transaction_id();
+        }
+        util::id_generator::node(0);
+    }
+
+    {
+        // 事务去重（相同 transaction_mask 只执行一次）
+        package bag(nullptr, package_type_enum::store, 100);
+        bag.capacity_cur(50);
+        auto goods3 = __goods[3];
+        auto reward = [&bag, &goods3](const std::string& mask) {
+            package_operator op(&bag, mask);
+            if (!op.replayed()) {
+                op.result(op.put(goods3, 10));
+            }
+            const auto state = op.try_commit();
+            assert(state == (op.replayed() ? package_operator::commit_result::replayed : package_operator::commit_result::ok));
+            return std::make_pair(op.transaction_id(), op.result());
+        };
+
+        const auto first = reward("reward-1");
+        assert(first.second == 10 && bag.count_of(3) == 10);
+        assert(reward("reward-1") == first && bag.count_of(3) == 10);     // 重试不再发放
+        {
+            package_operator op(&bag, std::string("reward-1"));
+            assert(op.replayed() && op.put(__goods[3], 10) == 0 && !op.aug(1));
+            op.commit().release();
+        }
+        assert(bag.count_of(3) == 10);
+        assert(reward("reward-2").first != first.first && bag.count_of(3) == 20);
+        {
+            // 冲突的事务不记录
+            package_operator op(&bag);
+            package_operator other(&bag, std::string("reward-3"));
+            assert(other.conflicted() && !other.replayed());
+            other.commit();
+        }
+        reward("reward-3");
+        assert(bag.count_of(3) == 30 && bag.dedup()->size() == 3);
+
+        // 超出容量覆盖最早的记录
+        bag.dedup_limit(2);
+        reward("a");
+        reward("b");
+        reward("c");
+        assert(bag.dedup()->size() == 2 && bag.count_of(3) == 60);
+        reward("a");
+        assert(bag.count_of(3) == 70);
+        reward("c");
+        assert(bag.count_of(3) == 70);
+
+        // 超过时间窗口视为新事务（窗口留足余量，避免两次 reward 之间被调度出去导致误判过期）
+        bag.dedup_limit(8, 200);
+        reward("d");
+        reward("d");
+        assert(bag.count_of(3) == 80);
+        std::this_thread::sleep_for(std::chrono::milliseconds(300));
+        reward("d");
+        assert(bag.count_of(3) == 90);
+    }
+
+    {
+        // 不带实例数据的道具共享注册表中的只读对象
+        static_assert(std::is_const<goods_ptr::element_type>::value, "slot goods must be read-only");
+        package first(nullptr, package_type_enum::store, 10);
+        package second(nullptr, package_type_enum::store, 10);
+        first.capacity_cur(10);
+        second.capacity_cur(10);
+        {
+            package_operator op(&first);
+            assert(op.put(__goods[3], 1, 0) == 1);
+            op.commit().release();
+        }
+        {
+            package_operator op(&second);
+            assert(op.put(__goods[3], 1, 0) == 1);
+            op.commit().release();
+        }
+        assert(first.get_slot(0)->_goods == second.get_slot(0)->_goods);
+        assert(first.get_slot(0)->_goods == goods_registry::instance().find(3));
+        assert(first.get_slot(0)->_goods->interned() && !__goods[3]->interned());
+
+        // 冻结后未登记的配置ID不共享
+        auto unknown = goods_registry::instance().intern(9001, goods_type_enum::item, 10);
+        assert(!unknown->interned() && goods_registry::instance().find(9001) == nullptr);
+        assert(goods_registry::instance().intern(9001, goods_type_enum::item, 10) != unknown);
+    }
+
+    {
+        // 只读视图
+        package bag(nullptr, package_type_enum::store, 100);
+        bag.capacity_cur(40);
+        assert(bag.view() == nullptr);
+        bag.enable_view(true);
+
+        auto before = bag.view();
+        assert(before && before->capacity_cur() == 40 && before->count_of(3) == 0);
+        {
+            package_operator op(&bag);
+            assert(op.put(__goods[3], 10) == 10);
+            assert(bag.view() == before);       // 未提交的改动不可见
+            op.commit().release();
+        }
+        auto after = bag.view();
+        assert(after != before && after->version() == bag.version());
+        assert(after->count_of(3) == 10 && before->count_of(3) == 0);
+        assert(after->get_slot(0)->_count == 10 && after->get_slot(40) == nullptr);
+
+        // 没有改动的块与上一个视图共享
+        const slot_id far = package_view::chunk_slots * 2;
+        {
+            package_operator op(&bag);
+            assert(op.put(__goods[3], 10, far) == 10);
+            op.commit().release();
+        }
+        auto last = bag.view();
+        assert(last->get_slot(0) == after->get_slot(0));
+        assert(last->get_slot(far) != after->get_slot(far) && last->get_slot(far)->_count == 10);
+
+        std::atomic<bool> stop{ false };
+        std::thread reader([&bag, &stop]() {
+            uint64_t version = 0;
+            while (!stop.load()) {
+                auto view = bag.view();
+                assert(view->version() >= version && view->count_of(3) % 10 == 0);
+                version = view->version();
+            }
+        });
+        for (int i = 0; i < 100; ++i) {
+            package_operator op(&bag);
+            op.put(__goods[3], 5);
+            op.put(__goods[3], 5);
+            op.commit().release();
+        }
+        stop = true;
+        reader.join();
+        assert(bag.view()->count_of(3) == 1020);
+
+        bag.enable_view(false);
+        assert(bag.view() == nullptr);
+    }
+
+    {
+        // 热路径统计
+        const auto before = package_stats::collect();
+        package bag(nullptr, package_type_enum::store, 100);
+        bag.capacity_cur(50);
+        {
+            package_operator op(&bag);
+            for (uint32_t i = 0; i < package_stats::latency_sample * 2; ++i) {
+                op.put(__goods[3], 1);
+            }
+            assert(op.rem(3, 5) == 5);
+            op.commit();
+            assert(op.put(__goods[3], 1) == 1);
+            op.rollback().release();
+        }
+        {
+            package_operator op(&bag);
+            package_operator other(&bag);
+            assert(other.conflicted());
+        }
+        const auto after = package_stats::collect();
+        auto delta = [&before, &after](stats_counter name) {
+            return after.counter(name) - before.counter(name);
+        };
+        if (package_stats::enabled) {
+            assert(delta(stats_counter::commits) == 1 && delta(stats_counter::rollbacks) == 1);
+            assert(delta(stats_counter::mark_conflicts) == 1);
+            assert(delta(stats_counter::partial_hit) + delta(stats_counter::partial_miss) >= package_stats::latency_sample * 2);
+            assert(after.count(stats_histogram::put_ns) - before.count(stats_histogram::put_ns) >= 2);
+            assert(after.count(stats_histogram::backup_slots) - before.count(stats_histogram::backup_slots) == 2);
+            assert(after.percentile(stats_histogram::put_ns, 0.99) >= after.percentile(stats_histogram::put_ns, 0.5));
+            assert(after.to_string().find("package_commits ") != std::string::npos);
+        }
+        else {
+            assert(after.counter(stats_counter::commits) == 0);
+        }
+        assert(package_stats::bucket(0) == 0 && package_stats::bucket(1) == 1 && package_stats::bucket(1000) == 10);
+    }
+
+    {
+        // 分片服务
+        package_service service(3);
+        for (uint64_t uuid = 1; uuid <= 30; ++uuid) {
+            assert(service.add_object(uuid).get());
+        }
+        assert(!service.add_object(7).get());
+
+        auto goods3 = __goods[3];
+        std::vector<std::future<uint32_t>> results;
+        for (int round = 0; round < 10; ++round) {
+            for (uint64_t uuid = 1; uuid <= 30; ++uuid) {
+                results.emplace_back(service.post(uuid, [goods3](object* pObject) -> uint32_t {
+                    package_operator op(pObject->store_package());
+                    const uint32_t result = op.put(goods3, 10);
+                    op.commit().release();
+                    return result;
+                }));
+            }
+        }
+        for (auto& result : results) {
+            assert(result.get() == 10);
+        }
+
+        std::atomic<uint64_t> total{ 0 };
+        for (uint64_t uuid = 1; uuid <= 30; ++uuid) {
+            service.post(uuid, [](object* pObject) { return pObject->store_package()->count_of(3); },
+                [&total](uint64_t count) { total += count; });
+        }
+        assert(service.post(31, [](object* pObject) { return pObject == nullptr; }).get());
+        assert(service.remove_object(30).get() && !service.remove_object(30).get());
+        for (uint64_t uuid = 1; uuid <= 30; ++uuid) {
+            service.post(uuid, [](object*) {}).get();    // 同一对象的命令按顺序执行
+        }
+        assert(total == 30 * 100);
+
+        // 命令抛出异常不结束分片线程
+        auto thrown = service.post(1, [](object*) -> int { throw std::runtime_error("command failed"); });
+        bool caught = false;
+        try {
+            thrown.get();
+        }
+        catch (const std::runtime_error&) {
+            caught = true;
+        }
+        assert(caught);
+        service.post(1, [](object*) -> int { throw std::runtime_error("callback command failed"); }, [](int) { assert(false); });
+        assert(service.post(1, [](object* pObject) { return pObject->store_package()->count_of(3); }).get() == 100);
+        uint64_t failed = 0;
+        for (uint32_t i = 0; i < service.shard_count(); ++i) {
+            failed += service.shard(i).failed();
+        }
+        assert(failed == 1);
+    }
+
     return 0;
 }
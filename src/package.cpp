@@ -3,7 +3,13 @@
 #include <algorithm>
 #include <cassert>
 
+#include "binary_stream.h"
 #include "goods.h"
+#include "package_dedup.h"
+#include "package_journal.h"
+#include "package_stats.h"
+#include "package_view.h"
+#include "util.h"
 
 
 std::string package_slot::debug_string() {
@@ -77,37 +83,57 @@ uint32_t package_slot::set_to(goods_ptr pGoods, uint32_t count) {
     return add(count);
 }
 
+std::pmr::memory_resource* package_operator::local_resource() {
+    static thread_local std::pmr::unsynchronized_pool_resource resource;
+    return &resource;
+}
+
 package_operator::package_operator(package_ptr package) : _package(package) {
-    assert(!_package->_operator_mark);
-    _package->_operator_mark = true;
+    acquire();
 
-    // TODO: _transaction_id
-    _backup_goods_slot = _package->_goods_slot;
-    _backup_capacity_cur = _package->_capacity_cur;
-    _backup_empty_slot_count = _package->_empty_slot_count;
-    _backup_empty_slot_next = _package->_empty_slot_next;
+    _transaction_id = util::id_generator::next();
+    backup_begin();
 }
 
 package_operator::package_operator(package_ptr package, std::string&& transaction_mask) : _package(package) {
-    assert(!_package->_operator_mark);
-    _package->_operator_mark = true;
+    acquire();
 
-    // TODO: _transaction_id
-    _backup_goods_slot = _package->_goods_slot;
-    _backup_capacity_cur = _package->_capacity_cur;
-    _backup_empty_slot_count = _package->_empty_slot_count;
-    _backup_empty_slot_next = _package->_empty_slot_next;
+    _transaction_id = util::id_generator::next();
+    check_replay(transaction_mask);
+    backup_begin();
 }
 
 package_operator::package_operator(package_ptr package, const std::string& transaction_mask) : _package(package) {
-    assert(!_package->_operator_mark);
-    _package->_operator_mark = true;
+    acquire();
 
-    // TODO: _transaction_id
-    _backup_goods_slot = _package->_goods_slot;
-    _backup_capacity_cur = _package->_capacity_cur;
-    _backup_empty_slot_count = _package->_empty_slot_count;
-    _backup_empty_slot_next = _package->_empty_slot_next;
+    _transaction_id = util::id_generator::next();
+    check_replay(transaction_mask);
+    backup_begin();
+}
+
+void package_operator::acquire() {
+    // 不再断言：已有事务在操作时进入冲突状态，由调用方决定重试
+    bool expected = false;
+    _conflict = !_package->_operator_mark.compare_exchange_strong(expected, true, std::memory_order_acquire);
+    if (_conflict)
+        PACKAGE_STATS_ADD(mark_conflicts, 1);
+}
+
+void package_operator::check_replay(const std::string& transaction_mask) {
+    if (_conflict || transaction_mask.empty())
+        return;
+
+    _transaction_mask = transaction_dedup::hash(transaction_mask);
+    if (!_package->_dedup)
+        return;
+
+    const auto* record = _package->_dedup->find(_transaction_mask);
+    if (record != nullptr) {
+        _replayed = true;
+        PACKAGE_STATS_ADD(replays, 1);
+        _transaction_id = record->_transaction_id;
+        _result = record->_result;
+    }
 }
 
 package_operator::~package_operator() {
@@ -117,19 +143,39 @@ package_operator::~package_operator() {
 void package_operator::release() {
     if (_package) {
         rollback();
+        if (_list_committed > 0) {
+            // release 由析构调用，接收者抛出的异常不能传出去（否则 std::terminate）
+            try {
+                notify();
+            }
+            catch (...) {
+                PACKAGE_STATS_ADD(notify_failures, 1);
+            }
+        }
 
-        _package->_operator_mark = false;
+        if (!_conflict)
+            _package->_operator_mark.store(false, std::memory_order_release);
         _package = nullptr;
+        _conflict = false;
 
-        _transaction_id.clear();
+        _transaction_id = 0;
+        _transaction_mask = 0;
+        _replayed = false;
+        _result = 0;
         _list.clear();
+        _list_committed = 0;
         _backup.clear();
+        _backup_pos.clear();
         _backup_goods_slot.clear();
+        _backup_goods_slot_rebuild = false;
+        _savepoints.clear();
     }
 }
 
 uint32_t package_operator::put(goods_ptr pGoods, uint32_t goods_count, slot_id slot /*= INVALID_SLOT*/, bool overlap /*= true*/) {
     assert(_package);
+    if (blocked()) return 0;
+    PACKAGE_STATS_LATENCY(put_ns);
 
     uint32_t result = 0;
 
@@ -142,8 +188,11 @@ uint32_t package_operator::put(goods_ptr pGoods, uint32_t goods_count, slot_id s
             return result;
     }
 
+    // 未指定格子时每轮都先补满已有堆叠
+    const bool auto_slot = slot == INVALID_SLOT;
+
     while (goods_count > 0) {
-        if (slot == INVALID_SLOT) {
+        if (auto_slot) {
             slot = _package->find_slot_existing(pGoods, overlap);
         }
         
@@ -157,33 +206,94 @@ uint32_t package_operator::put(goods_ptr pGoods, uint32_t goods_count, slot_id s
             return result;
         }
 
-        // backup
-        backup_slot(slot);
+        const auto filled = inner_put(pGoods, goods_count, slot, pSlot);
 
-        uint32_t filled = 0;
-        if (pSlot->empty()) {
-            _package->sub_empty_slot();
-            _package->reset_empty_slot_next(slot);  // 先重置，下次再更新
-            _package->add_goods_slot(pGoods->id(), slot);
-            filled = pSlot->set_to(goods::create(pGoods), goods_count);
-        }
-        else {
-            filled = pSlot->add(goods_count);
+        goods_count -= filled;
+        result += filled;
+    }
+
+    return result;
+}
+
+uint32_t package_operator::put_many(const std::vector<put_entry>& entries, std::vector<uint32_t>* placed /*= nullptr*/) {
+    assert(_package);
+    if (blocked()) return 0;
+
+    if (placed) placed->assign(entries.size(), 0);
+
+    // 按 (配置ID, 是否叠加) 合并
+    struct group {
+        goods_ptr _goods;
+        bool      _overlap;
+        uint64_t  _count;
+        uint64_t  _filled;
+    };
+    std::vector<group> groups;
+    std::vector<uint32_t> entry_group(entries.size(), UINT32_MAX);
+    flat_hash_map<uint64_t, uint32_t> group_index;
+    for (size_t i = 0; i < entries.size(); ++i) {
+        const auto& entry = entries[i];
+        if (!entry._goods || entry._count == 0)
+            continue;
+        const uint64_t key = (static_cast<uint64_t>(entry._goods->id()) << 1) | (entry._overlap ? 1 : 0);
+        auto iter = group_index.emplace(key, static_cast<uint32_t>(groups.size())).first;
+        if (iter->second == groups.size()) {
+            groups.emplace_back(group{ entry._goods, entry._overlap, 0, 0 });
         }
+        groups[iter->second]._count += entry._count;
+        entry_group[i] = iter->second;
+    }
 
-        if (filled > 0) {
-            _list.emplace_back(operator_info{ slot, package_operator::type::add, filled, pSlot->_goods, pSlot->_count });
+    auto fill = [this](group& one, slot_id slot) {
+        const auto count = static_cast<uint32_t>(std::min<uint64_t>(one._count - one._filled, UINT32_MAX));
+        one._filled += inner_put(one._goods, count, slot, _package->get_slot(slot));
+    };
+
+    // 先补已有堆叠
+    for (auto& one : groups) {
+        if (!one._overlap)
+            continue;
+        while (one._filled < one._count) {
+            const auto slot = _package->find_slot_existing(one._goods, true);
+            if (slot == INVALID_SLOT)
+                break;
+            fill(one, slot);
         }
+    }
 
-        goods_count -= filled;
-        result += filled;
+    // 再按升序一次性分配空格子（可叠加的组先补前面的组留下的未满堆叠）
+    slot_id cursor = 0;
+    for (auto& one : groups) {
+        while (one._filled < one._count) {
+            auto slot = _package->find_slot_existing(one._goods, one._overlap);
+            if (slot == INVALID_SLOT) {
+                slot = _package->first_empty_slot(cursor);
+                if (slot == INVALID_SLOT)
+                    break;
+                cursor = slot + 1;
+            }
+            fill(one, slot);
+        }
     }
 
+    // 按原顺序分摊到每一项
+    uint32_t result = 0;
+    for (size_t i = 0; i < entries.size(); ++i) {
+        if (entry_group[i] == UINT32_MAX)
+            continue;
+        auto& one = groups[entry_group[i]];
+        const auto share = static_cast<uint32_t>(std::min<uint64_t>(one._filled, entries[i]._count));
+        one._filled -= share;
+        result += share;
+        if (placed) (*placed)[i] = share;
+    }
     return result;
 }
 
-uint32_t package_operator::rem(uint32_t goods_id, uint32_t goods_count, slot_id slot) {
+uint32_t package_operator::rem(uint32_t goods_id, uint32_t goods_count, slot_id slot, bool require_all) {
     assert(_package);
+    if (blocked()) return 0;
+    PACKAGE_STATS_LATENCY(rem_ns);
 
     uint32_t result = 0;
 
@@ -191,18 +301,24 @@ uint32_t package_operator::rem(uint32_t goods_id, uint32_t goods_count, slot_id
 
     if (slot != INVALID_SLOT) {
         auto pSlot = _package->get_slot(slot);
+        if (require_all && (pSlot == nullptr || !pSlot->same(goods_id) || pSlot->_count < goods_count))
+            return result;
         return inner_rem(goods_id, goods_count, slot, pSlot);
     }
 
+    if (require_all && _package->count_of(goods_id) < goods_count)
+        return result;
+
     // 一次拷贝，循环内会操作这个容器
     auto slot_ids = _package->get_goods_slot(goods_id);
+    PACKAGE_STATS_ADD(rem_slot_copy, slot_ids.size());
     for (auto& slot_id_ : slot_ids) {
         auto pSlot = _package->get_slot(slot_id_);
         if (pSlot == nullptr) {
             return result;     // !! 中间空格子 !!
         }
         
-        auto sub_once = inner_rem(goods_id, goods_count, slot, pSlot);
+        auto sub_once = inner_rem(goods_id, goods_count, slot_id_, pSlot);
 
         goods_count -= sub_once;
         result += sub_once;
@@ -215,6 +331,54 @@ uint32_t package_operator::rem(uint32_t goods_id, uint32_t goods_count, slot_id
     return result;
 }
 
+uint32_t package_operator::rem_many(const std::vector<rem_entry>& entries, std::vector<uint32_t>* removed /*= nullptr*/, bool require_all /*= false*/) {
+    assert(_package);
+    if (blocked()) return 0;
+
+    if (removed) removed->assign(entries.size(), 0);
+
+    // 按配置ID合并
+    flat_hash_map<uint32_t, uint64_t> need;
+    for (const auto& entry : entries) {
+        if (entry._count > 0)
+            need[entry._goods_id] += entry._count;
+    }
+
+    if (require_all) {
+        for (const auto& iter : need) {
+            if (_package->count_of(iter.first) < iter.second)
+                return 0;
+        }
+    }
+
+    flat_hash_map<uint32_t, uint64_t> done;
+    for (const auto& iter : need) {
+        uint64_t left = iter.second;
+        // 一次拷贝，循环内会操作这个容器
+        const auto slot_ids = _package->get_goods_slot(iter.first);
+        for (const auto& slot : slot_ids) {
+            const auto count = static_cast<uint32_t>(std::min<uint64_t>(left, UINT32_MAX));
+            left -= inner_rem(iter.first, count, slot, _package->get_slot(slot));
+            if (left == 0)
+                break;
+        }
+        done.emplace(iter.first, iter.second - left);
+    }
+
+    // 按原顺序分摊到每一项
+    uint32_t result = 0;
+    for (size_t i = 0; i < entries.size(); ++i) {
+        auto iter = done.find(entries[i]._goods_id);
+        if (iter == done.end())
+            continue;
+        const auto share = static_cast<uint32_t>(std::min<uint64_t>(iter->second, entries[i]._count));
+        iter->second -= share;
+        result += share;
+        if (removed) (*removed)[i] = share;
+    }
+    return result;
+}
+
 bool package_operator::inner_swp(slot_id slot1, slot_id slot2, bool middle_modify) {
     assert(_package);
 
@@ -243,13 +407,19 @@ bool package_operator::inner_swp(slot_id slot1, slot_id slot2, bool middle_modif
     if (!pSlot1->empty() && !pSlot2->empty() &&
         pSlot1->can_filled(pSlot2->_goods, true)) {
 
-        pSlot2->sub(pSlot1->add(pSlot2->_count));
+        const auto goods_bak = pSlot2->_goods;
+        const auto merged = pSlot1->add(pSlot2->_count);
+        pSlot2->sub(merged);
+        _package->sync_slot(slot1);
+        _package->sync_slot(slot2);
 
         if (middle_modify) {
             if (pSlot2->empty()) {
-                _package->add_empty_slot();
-                _package->set_empty_slot_next(slot2);
-                _package->rem_goods_slot(pSlot1->_goods->id(), slot2);
+                rem_goods_slot(pSlot1->_goods->id(), slot2);
+            }
+            if (merged > 0) {
+                _list.emplace_back(operator_info{ slot1, package_operator::type::add, merged, pSlot1->_goods, pSlot1->_count });
+                _list.emplace_back(operator_info{ slot2, package_operator::type::sub, merged, goods_bak, pSlot2->_count });
             }
         }
 
@@ -260,26 +430,21 @@ bool package_operator::inner_swp(slot_id slot1, slot_id slot2, bool middle_modif
     if (middle_modify) {
         // 处理道具映射
         if (!pSlot1->empty())
-            _package->rem_goods_slot(pSlot1->_goods->id(), slot1);
+            rem_goods_slot(pSlot1->_goods->id(), slot1);
         if (!pSlot2->empty())
-            _package->rem_goods_slot(pSlot2->_goods->id(), slot2);
+            rem_goods_slot(pSlot2->_goods->id(), slot2);
     }
 
     if (_package->swap_slot(slot1, slot2)) {
         if (middle_modify) {
-            // 处理道具映射 & 更新空格子
-            if (!pSlot1->empty()) {
-                _package->add_goods_slot(pSlot1->_goods->id(), slot1);
-            }
-            else {
-                _package->set_empty_slot_next(slot1);
-            }
-            if (!pSlot2->empty()) {
-                _package->add_goods_slot(pSlot2->_goods->id(), slot2);
-            }
-            else {
-                _package->set_empty_slot_next(slot2);
-            }
+            // 处理道具映射
+            if (!pSlot1->empty())
+                add_goods_slot(pSlot1->_goods->id(), slot1);
+            if (!pSlot2->empty())
+                add_goods_slot(pSlot2->_goods->id(), slot2);
+
+            _list.emplace_back(operator_info{ slot1, package_operator::type::swp, pSlot1->_count, pSlot1->_goods, pSlot1->_count });
+            _list.emplace_back(operator_info{ slot2, package_operator::type::swp, pSlot2->_count, pSlot2->_goods, pSlot2->_count });
         }
         return true;
     }
@@ -287,9 +452,9 @@ bool package_operator::inner_swp(slot_id slot1, slot_id slot2, bool middle_modif
     if (middle_modify) {
         // 恢复道具映射
         if (!pSlot1->empty())
-            _package->add_goods_slot(pSlot1->_goods->id(), slot1);
+            add_goods_slot(pSlot1->_goods->id(), slot1);
         if (!pSlot2->empty())
-            _package->add_goods_slot(pSlot2->_goods->id(), slot2);
+            add_goods_slot(pSlot2->_goods->id(), slot2);
     }
 
     return false;
@@ -297,11 +462,15 @@ bool package_operator::inner_swp(slot_id slot1, slot_id slot2, bool middle_modif
 
 bool package_operator::swp(slot_id slot1, slot_id slot2) {
     assert(_package);
+    if (blocked()) return false;
+    PACKAGE_STATS_LATENCY(swp_ns);
     return inner_swp(slot1, slot2, true);
 }
 
 bool package_operator::aug(uint32_t inc) const {
     assert(_package);
+    if (blocked()) return false;
+    PACKAGE_STATS_LATENCY(aug_ns);
 
     if (_package->capacity_cur() == _package->capacity_max()
         || _package->capacity_cur() + inc >= _package->capacity_max()) {
@@ -309,106 +478,375 @@ bool package_operator::aug(uint32_t inc) const {
     }
 
     _package->capacity_cur(_package->capacity_cur() + inc);
-    _package->add_empty_slot(inc);
-    _package->set_empty_slot_next(_package->capacity_cur() - 1);
     return true;
 }
 
-bool package_operator::auto_pack() {
+uint32_t package_operator::move_to(package_operator& dst, slot_id src_slot, slot_id dst_slot, uint32_t count) {
+    assert(_package && dst._package);
+    if (blocked() || dst.blocked()) return 0;
+    PACKAGE_STATS_LATENCY(move_ns);
+
+    if (&dst == this || count == 0)
+        return 0;
+
+    auto pSrc = _package->get_slot(src_slot);
+    if (pSrc == nullptr || pSrc->empty())
+        return 0;
+
+    auto pGoods = pSrc->_goods;
+    count = std::min(count, pSrc->_count);
+
+    if (dst_slot == INVALID_SLOT) {
+        dst_slot = dst._package->find_slot_existing(pGoods, true);
+        if (dst_slot == INVALID_SLOT)
+            dst_slot = dst._package->get_empty_slot_id();
+    }
+    auto pDst = dst._package->get_slot(dst_slot);
+    if (pDst == nullptr || !dst._package->can_filled(dst_slot, pGoods->id(), true))
+        return 0;
+
+    const auto room = pGoods->overlap_max() - pDst->_count;
+    count = std::min(count, room);
+    if (count == 0)
+        return 0;
+
+    const auto moved = dst.inner_put(pGoods, count, dst_slot, pDst, count == pSrc->_count);
+    return inner_rem(pGoods->id(), moved, src_slot, pSrc);
+}
+
+bool package_operator::auto_pack(const pack_order& order, std::vector<slot_id>* changed) {
     assert(_package);
+    if (blocked()) return false;
+    PACKAGE_STATS_LATENCY(auto_pack_ns);
+
+    if (changed != nullptr)
+        changed->clear();
+
+    struct pack_stack {
+        goods_ptr _goods;             // 物品对象
+        uint32_t  _id = 0;            // 物品配置ID
+        uint32_t  _type = 0;          // 物品类型
+        uint32_t  _count = 0;         // 数量
+        slot_id   _slot = 0;          // 原格子（同键时保持原顺序）
+    };
+
+    // 收集非空格子：同配置（无实例状态）的数量直接累加，有实例状态的物品原样保留
+    struct pack_group {
+        slot_id  _first = 0;          // 第一个格子
+        uint64_t _total = 0;          // 总数量
+    };
+    static thread_local flat_hash_map<uint32_t, pack_group> groups;
+    groups.clear();
+
+    const auto capacity = _package->capacity_cur();
+    std::pmr::vector<pack_stack> packed{ local_resource() };
+    packed.reserve(capacity - _package->empty_slot_count());
+    for (slot_id slot = 0; slot < capacity; ++slot) {
+        const auto count = _package->_slot_count[slot];
+        if (count == 0)
+            continue;
+        const auto& pGoods = _package->_slot_array[slot]._goods;
+        if (pGoods->has_instance_state()) {
+            packed.emplace_back(pack_stack{ pGoods, _package->_slot_goods_id[slot],
+                static_cast<uint32_t>(pGoods->type()), count, slot });
+            continue;
+        }
+        auto& group = groups.emplace(_package->_slot_goods_id[slot], pack_group{ slot, 0 }).first->second;
+        group._total += count;
+    }
 
-    // 合并
-    _package->for_each_slot(0, [this](slot_id slot, package_slot* pSlot) -> bool {
-        if (pSlot == nullptr) {
-            // TODO: log error
-            return false;   // break
+    // 合并：按叠加上限切分
+    for (const auto& iter : groups) {
+        const auto& pGoods = _package->_slot_array[iter.second._first]._goods;
+        const uint32_t overlap_max = std::max<uint32_t>(pGoods->overlap_max(), 1);
+        const auto type = static_cast<uint32_t>(pGoods->type());
+        uint64_t total = iter.second._total;
+        for (slot_id index = 0; total > 0; ++index) {
+            const auto count = static_cast<uint32_t>(std::min<uint64_t>(total, overlap_max));
+            packed.emplace_back(pack_stack{ pGoods, iter.first, type, count, iter.second._first + index });
+            total -= count;
         }
-        if (pSlot->empty() || pSlot->full()) {
-            return true;
+    }
+
+    // 排序
+    auto compare_key = [](pack_key key, const pack_stack& lhs, const pack_stack& rhs) -> int {
+        uint32_t lhs_value = 0, rhs_value = 0;
+        switch (key) {
+        case pack_key::type:
+            lhs_value = lhs._type;
+            rhs_value = rhs._type;
+            break;
+        case pack_key::id:
+            lhs_value = lhs._id;
+            rhs_value = rhs._id;
+            break;
+        case pack_key::count:
+            lhs_value = lhs._count;
+            rhs_value = rhs._count;
+            break;
+        case pack_key::count_desc:
+            lhs_value = rhs._count;
+            rhs_value = lhs._count;
+            break;
         }
-        _package->for_each_slot(slot + 1, [this, slot, pSlot](slot_id slot_next, package_slot* pSlot_next) -> bool {
-            if (pSlot_next == nullptr) {
-                // TODO: log error
-                return false;  // break
-            }
-            if (pSlot_next->empty() || pSlot_next->full()) {
-                return true;
-            }
-            if (!pSlot->same(pSlot_next->_goods)) {
-                return true;
-            }
-            this->inner_swp(slot, slot_next, false);
-            if (pSlot->full()) {
-                return false;    // break;
-            }
-            return true;
-            }
-        );
-        return true;
+        return lhs_value < rhs_value ? -1 : (lhs_value > rhs_value ? 1 : 0);
+    };
+    std::sort(packed.begin(), packed.end(), [&order, &compare_key](const pack_stack& lhs, const pack_stack& rhs) {
+        for (auto key : order._keys) {
+            const int result = compare_key(key, lhs, rhs);
+            if (result != 0)
+                return result < 0;
         }
-    );
+        return lhs._slot < rhs._slot || (lhs._slot == rhs._slot && lhs._id < rhs._id);
+    });
+
+    // 写回：只备份/改动内容变化的格子，回滚时重建映射
+    bool modified = false;
+    for (slot_id slot = 0; slot < capacity; ++slot) {
+        auto& slot_ref = _package->_slot_array[slot];
+        const bool fill = slot < packed.size();
+        if (fill ? (slot_ref._goods == packed[slot]._goods && slot_ref._count == packed[slot]._count) : slot_ref.empty())
+            continue;
 
-    // 排序
-    auto& slot_array = _package->__get_slot_array();
-    auto capacity = _package->capacity_cur();
-    if (capacity <= 1) 
-        return true;
-    std::sort(std::begin(slot_array), std::begin(slot_array) + capacity,
-        [this](const package_slot& lhs, const package_slot& rhs) -> bool {
-            if (lhs.empty() && rhs.empty()) return false;
-            if (lhs.empty()) return false;
-            if (rhs.empty()) {
-                return true;
-            }
-            return lhs._goods->id() < rhs._goods->id()
-                || (lhs._goods->id() == rhs._goods->id() && lhs._count < rhs._count);
+        if (!modified) {
+            _backup_goods_slot.clear();
+            _backup_goods_slot_rebuild = true;
+            modified = true;
+        }
+        backup_slot(slot);
+        if (fill) {
+            slot_ref._goods = packed[slot]._goods;
+            slot_ref._count = packed[slot]._count;
         }
-    );
+        else {
+            slot_ref.to_empty();
+        }
+        _package->sync_slot(slot);
+        _list.emplace_back(operator_info{ slot, package_operator::type::swp, slot_ref._count, slot_ref._goods, slot_ref._count });
+        if (changed != nullptr)
+            changed->emplace_back(slot);
+    }
 
-    _package->re_init();
+    if (modified)
+        _package->re_init();
 
     return true;
 }
 
 package_operator& package_operator::commit() {
     assert(_package);
+    if (blocked()) return *this;
+
+    static thread_local std::vector<slot_id> slots;
+    slots.clear();
+
+    const bool capacity_changed = _backup_capacity_cur != _package->_capacity_cur;
+    PACKAGE_STATS_LATENCY_IF(commit_ns, capacity_changed || !_backup_pos.empty());
+    for (const auto& iter : _backup_pos) {
+        _package->mark_dirty(iter.first);
+        slots.emplace_back(iter.first);
+    }
+    if (capacity_changed) {
+        _package->_dirty_capacity = true;
+    }
+
+    if (!slots.empty() || capacity_changed) {
+        PACKAGE_STATS_ADD(commits, 1);
+        PACKAGE_STATS_RECORD(backup_slots, _backup.size());
+        PACKAGE_STATS_RECORD(backup_goods_slot, _backup_goods_slot.size());
+        std::sort(slots.begin(), slots.end());
+        _package->_version.fetch_add(1, std::memory_order_release);
+        if (_package->_journal != nullptr)
+            journal_commit(slots);
+        if (_package->_view_enabled)
+            _package->publish_view(&slots);
+    }
 
+    if (_transaction_mask != 0) {
+        if (!_package->_dedup)
+            _package->_dedup = std::make_unique<transaction_dedup>(package::dedup_capacity_default);
+        _package->_dedup->insert(_transaction_mask, _transaction_id, _result);
+    }
+
+    _list_committed = _list.size();
     _backup.clear();
-    _backup_goods_slot = _package->_goods_slot;
-    _backup_capacity_cur = _package->_capacity_cur;
-    _backup_empty_slot_count = _package->_empty_slot_count;
-    _backup_empty_slot_next = _package->_empty_slot_next;
+    _backup_pos.clear();
+    _savepoints.clear();
+    backup_begin();
 
     return *this;
 }
 
-package_operator& package_operator::rollback() {
+package_operator::commit_result package_operator::try_commit() {
     assert(_package);
+    if (_conflict) return commit_result::conflict;
+    if (_replayed) return commit_result::replayed;
 
-    for (const auto& iter : _backup) {
-        _package->cover_slot(iter.first, &iter.second);
+    if (_package->_version.load(std::memory_order_acquire) != _base_version) {
+        PACKAGE_STATS_ADD(version_conflicts, 1);
+        rollback();
+        backup_begin();
+        return commit_result::conflict;
     }
+    commit();
+    return commit_result::ok;
+}
 
-    _package->_capacity_cur = _backup_capacity_cur;
-    _package->_empty_slot_count = _backup_empty_slot_count;
-    _package->_empty_slot_next = _backup_empty_slot_next;
+package_operator& package_operator::rollback() {
+    assert(_package);
+    if (blocked()) return *this;
+
+    // release 时总会调用一次，没有改动的回滚不计入
+    const bool changed = !_backup.empty() || _backup_capacity_cur != _package->_capacity_cur;
+    PACKAGE_STATS_LATENCY_IF(rollback_ns, changed);
+    if (changed) {
+        PACKAGE_STATS_ADD(rollbacks, 1);
+        PACKAGE_STATS_RECORD(backup_slots, _backup.size());
+        PACKAGE_STATS_RECORD(backup_goods_slot, _backup_goods_slot.size());
+    }
 
-    _package->_goods_slot = _backup_goods_slot;
+    inner_rollback(savepoint_info{ 0, 0, 0, _backup_capacity_cur });
 
-    _backup.clear();
-    _list.clear();
+    // 已回到事务开始时的内容且映射已重建，之后可以重新记录变更
+    _backup_goods_slot_rebuild = false;
+    _backup_pos.clear();
+    _savepoints.clear();
 
     return *this;
 }
 
+package_operator::savepoint_id package_operator::savepoint() {
+    assert(_package);
+    if (blocked()) return static_cast<savepoint_id>(-1);
+
+    _savepoints.emplace_back(savepoint_info{ _list.size(), _backup.size(), _backup_goods_slot.size(),
+        _package->_capacity_cur });
+    return static_cast<savepoint_id>(_savepoints.size() - 1);
+}
+
+bool package_operator::rollback_to(savepoint_id sp) {
+    assert(_package);
+    if (blocked()) return false;
+
+    if (sp >= _savepoints.size())
+        return false;
+
+    inner_rollback(_savepoints[sp]);
+    _savepoints.resize(sp + 1);
+    return true;
+}
+
+bool package_operator::release_savepoint(savepoint_id sp) {
+    assert(_package);
+    if (blocked()) return false;
+
+    if (sp >= _savepoints.size())
+        return false;
+
+    _savepoints.resize(sp);
+    return true;
+}
+
+void package_operator::inner_rollback(const savepoint_info& info) {
+    assert(_package);
+
+    // 逆序恢复格子（同一格子多次备份时，最早的备份最后恢复）
+    while (_backup.size() > info._backup_size) {
+        const auto& iter = _backup.back();
+        _package->cover_slot(iter._slot, &iter._content);
+        // 保存点之前还有备份的格子仍然算改动过（提交时要标脏、写日志、发布视图）
+        if (iter._prev_pos == SIZE_MAX)
+            _backup_pos.erase(iter._slot);
+        else
+            _backup_pos[iter._slot] = iter._prev_pos;
+        _backup.pop_back();
+    }
+
+    _package->capacity_cur(info._capacity_cur);
+
+    if (_backup_goods_slot_rebuild) {
+        _package->re_init();
+        _backup_goods_slot.resize(std::min(_backup_goods_slot.size(), info._backup_goods_slot_size));
+    }
+    else {
+        // 逆序撤销映射变更
+        while (_backup_goods_slot.size() > info._backup_goods_slot_size) {
+            const auto& iter = _backup_goods_slot.back();
+            if (iter._added)
+                _package->rem_goods_slot(iter._goods_id, iter._slot);
+            else
+                _package->add_goods_slot(iter._goods_id, iter._slot);
+            _backup_goods_slot.pop_back();
+        }
+    }
+    // 变更记录被 auto_pack 清空过，回滚到更早的保存点也要重建映射，重建标记保持到 commit / 完整回滚
+
+    // 已提交的操作不回滚
+    while (_list.size() > std::max(info._list_size, _list_committed)) {
+        _list.pop_back();
+    }
+}
+
 void package_operator::notify() {
     assert(_package);
+    if (blocked()) return;
+
+    const size_t committed = _list_committed;
+    auto sink = _package->notify_sink();
+    if (sink != nullptr && committed > 0) {
+        // 线程内复用缓冲区，预热后不再分配（stable_sort 会分配临时缓冲，改为按 (格子, 操作序号) 排序）
+        static thread_local std::vector<std::pair<slot_id, size_t>> order;
+        static thread_local std::vector<slot_delta> deltas;
+        static thread_local std::string message;
+        order.clear();
+        deltas.clear();
+        for (size_t i = 0; i < committed; ++i) {
+            order.emplace_back(_list[i]._slot, i);
+        }
+        std::sort(order.begin(), order.end());
+
+        // 同一格子只保留最后一次操作后的状态
+        for (size_t i = 0; i < order.size(); ++i) {
+            if (i + 1 < order.size() && order[i + 1].first == order[i].first)
+                continue;
+            const auto& iter = _list[order[i].second];
+            deltas.emplace_back(slot_delta{ iter._slot, iter._goods ? iter._goods->id() : 0, iter._after_count });
+        }
 
-    // TODO: notify
-    for (const auto& iter : _list) {
+        encode_slot_delta(_package->type_enum(), _package->capacity_cur(), deltas, message);
+        sink->on_package_delta(_package, message);
+    }
 
+    // 保留未提交的部分，保存点的位置跟着前移
+    _list.erase(_list.begin(), _list.begin() + committed);
+    _list_committed = 0;
+    for (auto& iter : _savepoints) {
+        iter._list_size -= std::min(iter._list_size, committed);
     }
-    _list.clear();
+}
+
+void package_operator::backup_begin() {
+    assert(_package);
+    // 冲突时背包属于其他事务，不能读取它的容量和版本
+    if (_conflict)
+        return;
+
+    _backup_goods_slot.clear();
+    _backup_goods_slot_rebuild = false;
+    _backup_capacity_cur = _package->_capacity_cur;
+    _base_version = _package->_version.load(std::memory_order_acquire);
+}
+
+void package_operator::journal_commit(const std::vector<slot_id>& slots) {
+    assert(_package && _package->_journal);
+
+    static thread_local binary_writer writer;
+
+    writer.clear();
+    package_journal::encode_entry(_package, _package->_journal_seq + 1, slots, writer);
+    // 写入失败时不推进序号（journal_seq 只表示已写入的记录），改动仍标记为未保存，由存盘兜底
+    if (_package->_journal->append(writer.buffer()))
+        _package->_journal_seq += 1;
 }
 
 void package_operator::backup_slot(slot_id slot) {
@@ -416,12 +854,60 @@ void package_operator::backup_slot(slot_id slot) {
 
     auto pSlot = _package->get_slot(slot);
     if (pSlot == nullptr) return;
-    if (_backup.find(slot) == _backup.end()) {
-        // 这里用拷贝的方式!!
-        _backup.insert(std::make_pair(slot, *pSlot));
+
+    // 当前保存点之后已备份过则跳过
+    const size_t base = _savepoints.empty() ? 0 : _savepoints.back()._backup_size;
+    auto iter = _backup_pos.find(slot);
+    if (iter != _backup_pos.end() && iter->second >= base)
+        return;
+
+    const size_t prev_pos = iter != _backup_pos.end() ? iter->second : SIZE_MAX;
+    _backup_pos[slot] = _backup.size();
+    // 这里用拷贝的方式!!
+    _backup.emplace_back(backup_info{ slot, *pSlot, prev_pos });
+}
+
+void package_operator::add_goods_slot(uint32_t goods_id, slot_id slot) {
+    assert(_package);
+
+    if (_package->add_goods_slot(goods_id, slot) && !_backup_goods_slot_rebuild) {
+        _backup_goods_slot.emplace_back(goods_slot_undo{ goods_id, slot, true });
     }
 }
 
+void package_operator::rem_goods_slot(uint32_t goods_id, slot_id slot) {
+    assert(_package);
+
+    if (_package->rem_goods_slot(goods_id, slot) && !_backup_goods_slot_rebuild) {
+        _backup_goods_slot.emplace_back(goods_slot_undo{ goods_id, slot, false });
+    }
+}
+
+uint32_t package_operator::inner_put(goods_ptr pGoods, uint32_t goods_count, slot_id slot, package_slot* pSlot, bool adopt) {
+    assert(_package);
+
+    if (pSlot == nullptr)
+        return 0;
+
+    backup_slot(slot);
+
+    uint32_t filled = 0;
+    if (pSlot->empty()) {
+        add_goods_slot(pGoods->id(), slot);
+        filled = pSlot->set_to(adopt ? pGoods : goods_registry::instance().acquire(pGoods), goods_count);
+    }
+    else {
+        filled = pSlot->add(goods_count);
+    }
+    _package->sync_slot(slot);
+
+    if (filled > 0) {
+        _list.emplace_back(operator_info{ slot, package_operator::type::add, filled, pSlot->_goods, pSlot->_count });
+    }
+
+    return filled;
+}
+
 uint32_t package_operator::inner_rem(uint32_t goods_id, uint32_t goods_count, slot_id slot, package_slot* pSlot) {
     assert(_package);
 
@@ -436,11 +922,10 @@ uint32_t package_operator::inner_rem(uint32_t goods_id, uint32_t goods_count, sl
 
     uint32_t subed = pSlot->sub(goods_count);
     if (subed > 0 && pSlot->empty()) {
-        _package->add_empty_slot();
-        _package->set_empty_slot_next(slot);
-        _package->rem_goods_slot(goods_id, slot);
+        rem_goods_slot(goods_id, slot);
         pSlot->to_empty();
     }
+    _package->sync_slot(slot);
 
     if (subed > 0) {
         _list.emplace_back(operator_info{ slot, package_operator::type::sub, subed, goods_bak, pSlot->_count });
@@ -455,6 +940,18 @@ package::package(object* owner_, package_type_enum type_, uint32_t capacity_max_
     , _capacity_max(capacity_max_) {
 
     _slot_array.resize(capacity_max_);
+    _slot_goods_id.resize(capacity_max_);
+    _slot_count.resize(capacity_max_);
+    _slot_overlap_max.resize(capacity_max_);
+    _slot_goods_type.resize(capacity_max_, goods_type_enum::item);
+
+    _dirty_bits.assign((capacity_max_ + 63) / 64, 0);
+
+    // 初始全部为空格子
+    _slot_free_bits.assign((capacity_max_ + 63) / 64, ~0ull);
+    if (capacity_max_ % 64 != 0) {
+        _slot_free_bits.back() = (1ull << (capacity_max_ % 64)) - 1;
+    }
 }
 
 package::~package() {
@@ -463,124 +960,371 @@ package::~package() {
     _capacity_cur = 0;
     _capacity_max = 0;
     _slot_array.clear();
+    _slot_goods_id.clear();
+    _slot_count.clear();
+    _slot_overlap_max.clear();
+    _slot_goods_type.clear();
+    _slot_free_bits.clear();
+    _goods_partial.clear();
+    _goods_count.clear();
     _empty_slot_count = 0;
-    _empty_slot_next = INVALID_SLOT;
     _goods_slot.clear();
 }
 
 bool package::re_init() {
 
     _goods_slot.clear();
-    _empty_slot_count = 0;
-    _empty_slot_next = INVALID_SLOT;
 
-    for (slot_id one = 0; one < _capacity_cur; ++one) {
-        auto& slot_ref = _slot_array[one];
-        if (!slot_ref.empty()) {
-            _goods_slot[slot_ref._goods->id()].emplace(one);
+    for (slot_id one = 0; one < _capacity_max; ++one) {
+        sync_slot(one);
+        auto& bits = _slot_free_bits[one >> 6];
+        const auto mask = 1ull << (one & 63);
+        if (_slot_count[one] != 0) {
+            bits &= ~mask;
+            if (one < _capacity_cur)
+                _goods_slot[_slot_goods_id[one]].push_back(one);   // 顺序遍历，天然有序
             continue;
         }
-        _empty_slot_count += 1;
-        set_empty_slot_next(one);
+        bits |= mask;
     }
+    // sync_slot 会按变化增减计数，全部同步后再按位图重新统计
+    _empty_slot_count = count_empty_slot(0, _capacity_cur);
     return true;
 }
 
-void package::auto_pack() {
+void package::sync_slot(slot_id slot) {
+    const auto old_goods_id = _slot_goods_id[slot];
+    const auto old_count = _slot_count[slot];
+    const auto old_overlap_max = _slot_overlap_max[slot];
+    const bool was_empty = old_count == 0;
+
+    const auto& slot_ref = _slot_array[slot];
+    if (slot_ref.empty() || !slot_ref._goods) {
+        _slot_goods_id[slot] = 0;
+        _slot_count[slot] = 0;
+        _slot_overlap_max[slot] = 0;
+        _slot_goods_type[slot] = goods_type_enum::item;
+    }
+    else {
+        _slot_goods_id[slot] = slot_ref._goods->id();
+        _slot_count[slot] = slot_ref._count;
+        _slot_overlap_max[slot] = slot_ref._goods->overlap_max();
+        _slot_goods_type[slot] = slot_ref._goods->type();
+    }
 
-    assert(!_operator_mark);
+    // 未满堆叠 & 总数量
+    if (old_goods_id != _slot_goods_id[slot] || old_count != _slot_count[slot]) {
+        if (old_count != 0)
+            sub_goods_count(old_goods_id, old_count);
+        if (_slot_count[slot] != 0)
+            _goods_count[_slot_goods_id[slot]] += _slot_count[slot];
+        if (old_count != 0 && old_count < old_overlap_max)
+            rem_goods_partial(old_goods_id, slot, old_overlap_max - old_count);
+        if (_slot_count[slot] != 0 && _slot_count[slot] < _slot_overlap_max[slot])
+            add_goods_partial(_slot_goods_id[slot], slot, _slot_overlap_max[slot] - _slot_count[slot]);
+    }
 
-    package_operator oper(this);
-    oper.auto_pack();
-    oper.commit();
-}
+    const bool now_empty = _slot_count[slot] == 0;
+    if (was_empty == now_empty)
+        return;
 
-void package::for_each_slot(std::function<bool(package_slot*)>&& caller) {
-    using __Caller = std::function<bool(package_slot*)>;
-    for_each_slot(0, std::forward<__Caller>(caller));
+    _slot_free_bits[slot >> 6] ^= 1ull << (slot & 63);
+    if (slot < _capacity_cur) {
+        now_empty ? ++_empty_slot_count : --_empty_slot_count;
+    }
 }
 
-void package::for_each_slot(std::function<bool(slot_id, package_slot*)>&& caller) {
-    using __Caller = std::function<bool(slot_id, package_slot*)>;
-    for_each_slot(0, std::forward<__Caller>(caller));
+void package::capacity_cur(uint32_t cur) {
+    cur = std::min(cur, _capacity_max);
+    if (cur > _capacity_cur)
+        _empty_slot_count += count_empty_slot(_capacity_cur, cur);
+    else
+        _empty_slot_count -= count_empty_slot(cur, _capacity_cur);
+    _capacity_cur = cur;
 }
 
-void package::for_each_slot(slot_id start, std::function<bool(package_slot*)>&& caller) {
-    for (slot_id one = start; one < _capacity_cur; ++one) {
-        if (!caller(&_slot_array[one]))
-            break;
+slot_id package::first_empty_slot(slot_id start) const {
+    if (start >= _capacity_cur)
+        return INVALID_SLOT;
+
+    const size_t words = (_capacity_cur + 63) / 64;
+    size_t word = start >> 6;
+    uint64_t bits = _slot_free_bits[word] & (~0ull << (start & 63));
+    PACKAGE_STATS_ADD(empty_scans, 1);
+    while (bits == 0) {
+        if (++word >= words) {
+            PACKAGE_STATS_ADD(empty_scan_words, word - (start >> 6));
+            return INVALID_SLOT;
+        }
+        bits = _slot_free_bits[word];
     }
+    PACKAGE_STATS_ADD(empty_scan_words, word - (start >> 6) + 1);
+    const slot_id result = static_cast<slot_id>(word * 64 + util::ctz64(bits));
+    return result < _capacity_cur ? result : INVALID_SLOT;
 }
 
-void package::for_each_slot(slot_id start, std::function<bool(slot_id, package_slot*)>&& caller) {
-    for (slot_id one = start; one < _capacity_cur; ++one) {
-        if (!caller(one, &_slot_array[one]))
-            break;
+slot_id package::first_occupied_slot(slot_id start) const {
+    if (start >= _capacity_cur)
+        return INVALID_SLOT;
+
+    const size_t words = (_capacity_cur + 63) / 64;
+    size_t word = start >> 6;
+    uint64_t bits = ~_slot_free_bits[word] & (~0ull << (start & 63));
+    while (bits == 0) {
+        if (++word >= words)
+            return INVALID_SLOT;
+        bits = ~_slot_free_bits[word];
     }
+    const slot_id result = static_cast<slot_id>(word * 64 + util::ctz64(bits));
+    return result < _capacity_cur ? result : INVALID_SLOT;
 }
 
-void package::reset_empty_slot_next(slot_id slot) {
-    if (slot == _empty_slot_next) _empty_slot_next = INVALID_SLOT;
-    static constexpr slot_id max_re_get_count = 11;
-    slot_id retry = 1;
-    slot_id offset = 0;
-    while (retry < max_re_get_count) {
-        slot_id next = slot + retry;
-        if (next >= _capacity_cur) {
-            next = offset;
-            ++offset;
-        }
-        if (_slot_array[next].empty()) {
-            _empty_slot_next = next;
-            break;
-        }
-        ++retry;
+uint32_t package::count_empty_slot(slot_id begin, slot_id end) const {
+    uint32_t result = 0;
+    while (begin < end) {
+        const auto offset = begin & 63;
+        const auto span = std::min<uint32_t>(64 - offset, end - begin);
+        uint64_t mask = span == 64 ? ~0ull : ((1ull << span) - 1) << offset;
+        result += util::popcount64(_slot_free_bits[begin >> 6] & mask);
+        begin += span;
     }
+    return result;
 }
 
-const std::set<slot_id>& package::get_goods_slot(uint32_t goods_id) {
-    static const std::set<slot_id> empty_result;
+void package::auto_pack(const pack_order& order, std::vector<slot_id>* changed) {
+
+    assert(!_operator_mark);
+
+    package_operator oper(this);
+    oper.auto_pack(order, changed);
+    oper.commit();
+    oper.notify();
+}
+
+const slot_set& package::get_goods_slot(uint32_t goods_id) {
+    static const slot_set empty_result{};
     auto iter = _goods_slot.find(goods_id);
     if (iter != _goods_slot.end()) 
         return iter->second;
     return empty_result;
 }
 
-void package::add_goods_slot(uint32_t goods_id, slot_id slot) {
+bool package::add_goods_slot(uint32_t goods_id, slot_id slot) {
     auto iter = _goods_slot.find(goods_id);
     if (iter == _goods_slot.end()) {
-        iter = _goods_slot.emplace(goods_id, std::set<slot_id>()).first;
+        iter = _goods_slot.emplace(goods_id).first;
     }
-    iter->second.emplace(slot);
+    return iter->second.insert_sorted(slot);
 }
 
-void package::rem_goods_slot(uint32_t goods_id, slot_id slot) {
+bool package::rem_goods_slot(uint32_t goods_id, slot_id slot) {
 
     auto iter = _goods_slot.find(goods_id);
-    if (iter != _goods_slot.end())
-        iter->second.erase(slot);
+    if (iter == _goods_slot.end())
+        return false;
+    const bool erased = iter->second.erase_sorted(slot);
+    if (iter->second.empty())
+        _goods_slot.erase(iter);
+    return erased;
 }
 
 slot_id package::find_slot_existing(goods_ptr pGoods, bool overlap) {
-    const auto& slots = get_goods_slot(pGoods->id());
-    for (const auto& one : slots) {
-        if (_slot_array[one].can_filled(pGoods, overlap))
-            return one;
+    if (!overlap)
+        return INVALID_SLOT;
+    auto iter = _goods_partial.find(pGoods->id());
+    if (iter == _goods_partial.end()) {
+        PACKAGE_STATS_ADD(partial_miss, 1);
+        return INVALID_SLOT;
     }
-    return INVALID_SLOT;
+    PACKAGE_STATS_ADD(partial_hit, 1);
+    return iter->second._slots.front();
 }
 
 slot_id package::find_slot(goods_ptr pGoods, slot_id start, bool overlap) {
+    const auto goods_id = pGoods->id();
+
+    PACKAGE_STATS_ADD(find_calls, 1);
+    if (start >= _capacity_cur)
+        return INVALID_SLOT;
+    if (can_filled(start, goods_id, overlap)) {
+        PACKAGE_STATS_ADD(find_start_hit, 1);
+        return start;
+    }
 
-    if (start <= _empty_slot_next 
-        && _empty_slot_next < _capacity_cur 
-        && _slot_array[_empty_slot_next].can_filled(pGoods, overlap)) {
-        return _empty_slot_next;
+    // start 之后第一个可填充的格子：空格子 或 同物品未满的格子，取靠前的
+    slot_id result = first_empty_slot(start);
+    if (overlap) {
+        auto partial = _goods_partial.find(goods_id);
+        if (partial != _goods_partial.end()) {
+            auto iter = partial->second._slots.lower_bound(start);
+            if (iter != partial->second._slots.end() && *iter < result)
+                return *iter;
+        }
     }
+    return result;
+}
 
-    for (slot_id one = start; one < _capacity_cur; ++one) {
-        if (_slot_array[one].can_filled(pGoods, overlap))
-            return one;
+void package::dedup_limit(uint32_t capacity, uint32_t horizon_mill) {
+    assert(!_operator_mark);
+    _dedup = std::make_unique<transaction_dedup>(capacity, horizon_mill);
+}
+
+void package::enable_view(bool enable) {
+    assert(!_operator_mark);
+
+    _view_enabled = enable;
+    if (enable)
+        publish_view(nullptr);
+    else
+        std::atomic_store(&_view, std::shared_ptr<const package_view>());
+}
+
+std::shared_ptr<const package_view> package::view() const {
+    return std::atomic_load(&_view);
+}
+
+void package::publish_view(const std::vector<slot_id>* slots) {
+    const auto chunk_count = (_capacity_max + package_view::chunk_slots - 1) / package_view::chunk_slots;
+    auto copy_chunk = [this](uint32_t index) {
+        auto result = std::make_shared<package_view::chunk>();
+        const slot_id begin = index * package_view::chunk_slots;
+        const slot_id end = std::min<slot_id>(begin + package_view::chunk_slots, _capacity_max);
+        for (slot_id slot = begin; slot < end; ++slot) {
+            result->_slots[slot - begin] = _slot_array[slot];
+        }
+        return result;
+    };
+
+    // 写入方是唯一修改 _view 的线程，可以直接读取
+    auto view = std::make_shared<package_view>();
+    view->_version = _version.load(std::memory_order_relaxed);
+    view->_capacity_cur = _capacity_cur;
+    view->_capacity_max = _capacity_max;
+    if (slots == nullptr || !_view) {
+        view->_chunks.reserve(chunk_count);
+        for (uint32_t index = 0; index < chunk_count; ++index) {
+            view->_chunks.emplace_back(copy_chunk(index));
+        }
+    }
+    else {
+        view->_chunks = _view->_chunks;
+        uint32_t last = UINT32_MAX;
+        for (auto slot : *slots) {
+            const uint32_t index = slot / package_view::chunk_slots;
+            if (index != last) {
+                view->_chunks[index] = copy_chunk(index);
+                last = index;
+            }
+        }
     }
-    return INVALID_SLOT;
+    std::atomic_store(&_view, std::shared_ptr<const package_view>(std::move(view)));
+}
+
+bool package::collect_dirty(std::vector<slot_id>& slots) {
+    slots.clear();
+    slots.reserve(_dirty_count);
+    for (size_t word = 0; word < _dirty_bits.size() && slots.size() < _dirty_count; ++word) {
+        uint64_t bits = _dirty_bits[word];
+        while (bits != 0) {
+            slots.emplace_back(static_cast<slot_id>(word * 64 + util::ctz64(bits)));
+            bits &= bits - 1;
+        }
+        _dirty_bits[word] = 0;
+    }
+    _dirty_count = 0;
+
+    const bool capacity_changed = _dirty_capacity;
+    _dirty_capacity = false;
+    return capacity_changed;
+}
+
+bool package::restore_slot(slot_id slot, goods_ptr pGoods, uint32_t count) {
+    if (slot >= _capacity_max)
+        return false;
+
+    auto& slot_ref = _slot_array[slot];
+    if (!pGoods || count == 0) {
+        slot_ref.to_empty();
+    }
+    else {
+        slot_ref._goods = std::move(pGoods);
+        slot_ref._count = count;
+    }
+    sync_slot(slot);
+    return true;
+}
+
+uint64_t package::count_of(uint32_t goods_id) const {
+    auto iter = _goods_count.find(goods_id);
+    return iter != _goods_count.end() ? iter->second : 0;
+}
+
+void package::sub_goods_count(uint32_t goods_id, uint64_t count) {
+    auto iter = _goods_count.find(goods_id);
+    if (iter == _goods_count.end())
+        return;
+    if (iter->second <= count)
+        _goods_count.erase(iter);
+    else
+        iter->second -= count;
+}
+
+uint32_t package::stack_room(uint32_t goods_id) const {
+    auto iter = _goods_partial.find(goods_id);
+    return iter != _goods_partial.end() ? iter->second._room : 0;
+}
+
+bool package::can_put_all(const std::vector<put_entry>& entries, std::vector<uint32_t>* placed) const {
+    if (placed) placed->assign(entries.size(), 0);
+
+    bool result = true;
+    uint32_t empty_left = _empty_slot_count;
+    flat_hash_map<uint32_t, uint64_t> room;     // 物品配置id->计算过程中的剩余堆叠空间
+
+    for (size_t i = 0; i < entries.size(); ++i) {
+        const auto& entry = entries[i];
+        if (!entry._goods || entry._count == 0)
+            continue;
+
+        const auto goods_id = entry._goods->id();
+        const uint64_t overlap_max = entry._goods->overlap_max();
+        auto iter = room.find(goods_id);
+        if (iter == room.end()) {
+            iter = room.emplace(goods_id, stack_room(goods_id)).first;
+        }
+
+        uint64_t left = entry._count;
+        if (entry._overlap) {
+            const auto take = std::min(left, iter->second);
+            iter->second -= take;
+            left -= take;
+        }
+        if (left > 0 && overlap_max > 0) {
+            const uint64_t use = std::min<uint64_t>((left + overlap_max - 1) / overlap_max, empty_left);
+            const uint64_t fill = std::min(left, use * overlap_max);
+            empty_left -= static_cast<uint32_t>(use);
+            left -= fill;
+            iter->second += use * overlap_max - fill;
+        }
+
+        if (placed) (*placed)[i] = entry._count - static_cast<uint32_t>(left);
+        if (left > 0) result = false;
+    }
+    return result;
+}
+
+void package::add_goods_partial(uint32_t goods_id, slot_id slot, uint32_t room) {
+    auto& partial = _goods_partial[goods_id];
+    partial._slots.insert_sorted(slot);
+    partial._room += room;
+}
+
+void package::rem_goods_partial(uint32_t goods_id, slot_id slot, uint32_t room) {
+    auto iter = _goods_partial.find(goods_id);
+    if (iter == _goods_partial.end())
+        return;
+    iter->second._slots.erase_sorted(slot);
+    iter->second._room -= room;
+    if (iter->second._slots.empty())
+        _goods_partial.erase(iter);
 }
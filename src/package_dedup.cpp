@@ -0,0 +1,46 @@
+#include "package_dedup.h"
+
+#include <cassert>
+#include <functional>
+
+#include "util.h"
+
+transaction_dedup::transaction_dedup(uint32_t capacity, uint32_t horizon_mill)
+    : _ring(capacity > 0 ? capacity : 1)
+    , _horizon_mill(horizon_mill) {
+    _index.reserve(_ring.size());
+}
+
+uint64_t transaction_dedup::hash(const std::string& mask) {
+    const uint64_t result = std::hash<std::string>()(mask);
+    return result != 0 ? result : 1;
+}
+
+const transaction_dedup::record* transaction_dedup::find(uint64_t mask_hash) const {
+    auto iter = _index.find(mask_hash);
+    if (iter == _index.end())
+        return nullptr;
+
+    const auto& result = _ring[iter->second];
+    if (_horizon_mill != 0 && util::ticks<std::chrono::milliseconds>() - result._commit_mill > _horizon_mill)
+        return nullptr;
+    return &result;
+}
+
+void transaction_dedup::insert(uint64_t mask_hash, uint64_t transaction_id, uint64_t result) {
+    assert(mask_hash != 0);
+
+    const uint64_t now_mill = _horizon_mill != 0 ? util::ticks<std::chrono::milliseconds>() : 0;
+    auto iter = _index.find(mask_hash);
+    if (iter != _index.end()) {
+        _ring[iter->second] = record{ mask_hash, transaction_id, result, now_mill };
+        return;
+    }
+
+    auto& slot = _ring[_next];
+    if (slot._mask_hash != 0)
+        _index.erase(slot._mask_hash);
+    slot = record{ mask_hash, transaction_id, result, now_mill };
+    _index.emplace(mask_hash, _next);
+    _next = (_next + 1) % static_cast<uint32_t>(_ring.size());
+}
@@ -0,0 +1,304 @@
+#include "package_journal.h"
+
+#include <cassert>
+#include <chrono>
+
+#if defined(_MSC_VER)
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "binary_stream.h"
+#include "goods.h"
+#include "object.h"
+#include "util.h"
+
+static constexpr uint8_t journal_version = 1;
+static constexpr uint32_t journal_frame_header = 8;
+static constexpr uint32_t journal_entry_max = 16 * 1024 * 1024;
+
+package_journal::~package_journal() {
+    close();
+}
+
+bool package_journal::open(const std::string& path, uint32_t sync_interval_ms) {
+    if (_file != nullptr)
+        return false;
+
+    _file = std::fopen(path.c_str(), "ab");
+    if (_file == nullptr)
+        return false;
+
+    _sync_interval_ms = sync_interval_ms;
+    _stop = false;
+    if (_sync_interval_ms > 0) {
+        _flusher = std::thread(&package_journal::flusher_loop, this);
+    }
+    return true;
+}
+
+void package_journal::close() {
+    if (_file == nullptr)
+        return;
+
+    if (_flusher.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _stop = true;
+        }
+        _cond.notify_one();
+        _flusher.join();
+    }
+    write_pending();
+    std::fclose(_file);
+    _file = nullptr;
+}
+
+bool package_journal::append(const std::string& payload) {
+    if (_file == nullptr || payload.size() > journal_entry_max || failed())
+        return false;
+
+    uint8_t header[journal_frame_header];
+    const auto size = static_cast<uint32_t>(payload.size());
+    const auto crc = util::crc32(payload.data(), payload.size());
+    for (int i = 0; i < 4; ++i) {
+        header[i] = static_cast<uint8_t>(size >> (i * 8));
+        header[4 + i] = static_cast<uint8_t>(crc >> (i * 8));
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _pending.append(reinterpret_cast<const char*>(header), sizeof(header));
+        _pending.append(payload);
+    }
+    _append_count.fetch_add(1, std::memory_order_relaxed);
+
+    if (_sync_interval_ms == 0) {
+        return write_pending();
+    }
+    return true;
+}
+
+bool package_journal::flush() {
+    if (_file == nullptr)
+        return false;
+    return write_pending();
+}
+
+bool package_journal::write_pending() {
+    std::lock_guard<std::mutex> write_lock(_write_mutex);
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (failed()) {
+            // 失败之后文件尾部可能是半帧，再追加的记录重放时也读不到
+            _pending.clear();
+            return false;
+        }
+        if (_pending.empty())
+            return true;
+        _writing.swap(_pending);
+    }
+
+    bool ok = std::fwrite(_writing.data(), 1, _writing.size(), _file) == _writing.size();
+    ok = ok && std::fflush(_file) == 0;
+#if defined(_MSC_VER)
+    ok = ok && _commit(_fileno(_file)) == 0;
+#else
+    ok = ok && fsync(fileno(_file)) == 0;
+#endif
+    _writing.clear();
+    if (!ok) {
+        _failed.store(true, std::memory_order_release);
+        return false;
+    }
+    _sync_count.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+void package_journal::flusher_loop() {
+    std::unique_lock<std::mutex> lock(_mutex);
+    while (!_stop) {
+        _cond.wait_for(lock, std::chrono::milliseconds(_sync_interval_ms), [this]() { return _stop; });
+        lock.unlock();
+        write_pending();
+        lock.lock();
+    }
+}
+
+void package_journal::encode_entry(const package* package, uint64_t seq, const std::vector<slot_id>& slots, binary_writer& out) {
+    assert(package);
+
+    out.write_u8(journal_version);
+    out.write_varint(seq);
+    out.write_varint(package->_owner ? package->_owner->uuid() : 0);
+    out.write_varint(static_cast<uint32_t>(package->_type));
+    out.write_varint(package->_capacity_cur);
+    out.write_varint(slots.size());
+    for (auto slot : slots) {
+        const auto& slot_ref = package->_slot_array[slot];
+        out.write_varint(slot);
+        out.write_varint(slot_ref._count);
+        if (slot_ref._count > 0) {
+            out.write_varint(slot_ref._goods->id());
+            out.write_varint(static_cast<uint32_t>(slot_ref._goods->type()));
+            out.write_varint(slot_ref._goods->overlap_max());
+            out.write_varint(slot_ref._goods->uuid());
+        }
+    }
+}
+
+namespace {
+
+    struct journal_entry_header {
+        uint64_t _seq = 0;
+        uint64_t _uuid = 0;
+        uint32_t _type = 0;
+        uint32_t _capacity = 0;
+    };
+
+    struct journal_slot {
+        uint32_t _slot = 0;
+        uint32_t _count = 0;
+        uint32_t _goods_id = 0;
+        uint32_t _goods_type = 0;
+        uint32_t _overlap_max = 0;
+        uint64_t _goods_uuid = 0;
+    };
+
+    /// <summary>
+    /// 解码一条记录（payload 已通过 crc 校验）
+    /// </summary>
+    bool decode_entry(const char* payload, uint32_t size, journal_entry_header& header, std::vector<journal_slot>& slots) {
+        binary_reader reader(payload, size);
+        uint8_t version = 0;
+        uint64_t count = 0;
+        if (!reader.read_u8(version) || version != journal_version)
+            return false;
+        if (!reader.read_varint(header._seq) || !reader.read_varint(header._uuid)
+            || !reader.read_varint(header._type) || !reader.read_varint(header._capacity) || !reader.read_varint(count))
+            return false;
+        if (count > size)       // 每个格子至少 2 字节，防止损坏的数量导致巨量分配
+            return false;
+
+        slots.clear();
+        slots.resize(static_cast<size_t>(count));
+        for (auto& one : slots) {
+            reader.read_varint(one._slot);
+            reader.read_varint(one._count);
+            if (one._count > 0) {
+                reader.read_varint(one._goods_id);
+                reader.read_varint(one._goods_type);
+                reader.read_varint(one._overlap_max);
+                reader.read_varint(one._goods_uuid);
+            }
+            if (!reader.ok())
+                return false;
+        }
+        return true;
+    }
+
+} // end namespace
+
+bool package_journal::replay_index::load(const std::string& path) {
+    _data.clear();
+    _records.clear();
+    _count = 0;
+
+    FILE* file = std::fopen(path.c_str(), "rb");
+    if (file == nullptr)
+        return false;
+
+    char buffer[64 * 1024];
+    size_t read_size = 0;
+    while ((read_size = std::fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        _data.append(buffer, read_size);
+    }
+    std::fclose(file);
+
+    static thread_local std::vector<journal_slot> slots;
+    size_t offset = 0;
+    while (_data.size() - offset >= journal_frame_header) {
+        binary_reader frame(_data.data() + offset, journal_frame_header);
+        uint32_t size = 0, crc = 0;
+        frame.read_u32(size);
+        frame.read_u32(crc);
+        if (size > journal_entry_max || size > _data.size() - offset - journal_frame_header)
+            break;
+
+        const auto* payload = _data.data() + offset + journal_frame_header;
+        journal_entry_header header;
+        if (util::crc32(payload, size) != crc || !decode_entry(payload, size, header, slots))
+            break;
+
+        _records[header._uuid].emplace_back(record{ header._type, header._seq, offset + journal_frame_header, size });
+        offset += journal_frame_header + size;
+        ++_count;
+    }
+    _data.resize(offset);
+    return true;
+}
+
+uint64_t package_journal::replay_index::apply(package* package) const {
+    assert(package && !package->_operator_mark);
+
+    auto iter = _records.find(package->_owner ? package->_owner->uuid() : 0);
+    if (iter == _records.end())
+        return 0;
+
+    uint64_t applied = 0;
+    for (const auto& one : iter->second) {
+        if (one._type != static_cast<uint32_t>(package->_type) || one._seq <= package->_journal_seq)
+            continue;
+        if (!apply_entry(_data.data() + one._offset, one._size, package))
+            break;
+        ++applied;
+    }
+
+    if (applied > 0) {
+        package->re_init();
+        package->_version.fetch_add(1, std::memory_order_release);
+        if (package->_view_enabled)
+            package->publish_view(nullptr);
+    }
+    return applied;
+}
+
+uint64_t package_journal::replay(const std::string& path, package* package) {
+    replay_index index;
+    if (!index.load(path))
+        return 0;
+    return index.apply(package);
+}
+
+bool package_journal::apply_entry(const char* payload, uint32_t size, package* package) {
+    static thread_local std::vector<journal_slot> slots;
+
+    // 先完整解码校验，再写入背包
+    journal_entry_header header;
+    if (!decode_entry(payload, size, header, slots) || header._capacity > package->_capacity_max)
+        return false;
+    for (const auto& one : slots) {
+        if (one._slot >= package->_capacity_max)
+            return false;
+    }
+
+    if (package->_capacity_cur != header._capacity) {
+        package->capacity_cur(header._capacity);
+        package->_dirty_capacity = true;
+    }
+    for (const auto& one : slots) {
+        package->mark_dirty(one._slot);
+        if (one._count == 0) {
+            package->restore_slot(one._slot, nullptr, 0);
+            continue;
+        }
+
+        goods_ptr pGoods = static_cast<goods_type_enum>(one._goods_type) == goods_type_enum::item
+            ? goods_registry::instance().intern(one._goods_id, goods_type_enum::item, one._overlap_max)
+            : goods::create(one._goods_uuid, one._goods_id, static_cast<goods_type_enum>(one._goods_type), one._overlap_max);
+        package->restore_slot(one._slot, std::move(pGoods), one._count);
+    }
+    package->_journal_seq = header._seq;
+    return true;
+}
@@ -0,0 +1,58 @@
+#include "package_notify.h"
+
+#include "binary_stream.h"
+
+static constexpr uint8_t slot_delta_version = 1;
+
+void encode_slot_delta(package_type_enum type, uint32_t capacity, const std::vector<slot_delta>& deltas, std::string& out) {
+    // 借用 out 的缓冲区，调用方复用 out 时不再分配
+    binary_writer writer;
+    writer.buffer().swap(out);
+    writer.clear();
+    writer.write_u8(slot_delta_version);
+    writer.write_varint(static_cast<uint32_t>(type));
+    writer.write_varint(capacity);
+    writer.write_varint(deltas.size());
+
+    slot_id prev = 0;
+    for (const auto& one : deltas) {
+        writer.write_varint(one._slot - prev);
+        writer.write_varint(one._count);
+        if (one._count > 0)
+            writer.write_varint(one._goods_id);
+        prev = one._slot;
+    }
+    out.swap(writer.buffer());
+}
+
+bool decode_slot_delta(const void* data, size_t size, package_type_enum& type, uint32_t& capacity, std::vector<slot_delta>& deltas) {
+    binary_reader reader(data, size);
+
+    uint8_t version = 0;
+    uint32_t type_value = 0;
+    uint64_t count = 0;
+    if (!reader.read_u8(version) || version != slot_delta_version)
+        return false;
+    if (!reader.read_varint(type_value) || !reader.read_varint(capacity) || !reader.read_varint(count))
+        return false;
+    if (count > reader.remain())
+        return false;
+
+    type = static_cast<package_type_enum>(type_value);
+    deltas.clear();
+    deltas.reserve(static_cast<size_t>(count));
+
+    slot_id prev = 0;
+    for (uint64_t i = 0; i < count; ++i) {
+        uint32_t gap = 0;
+        slot_delta one;
+        if (!reader.read_varint(gap) || !reader.read_varint(one._count))
+            return false;
+        if (one._count > 0 && !reader.read_varint(one._goods_id))
+            return false;
+        one._slot = prev + gap;
+        prev = one._slot;
+        deltas.emplace_back(one);
+    }
+    return reader.ok();
+}
@@ -0,0 +1,116 @@
+#include "package_service.h"
+
+#include <cassert>
+
+#include "object.h"
+
+package_shard::~package_shard() {
+    stop();
+}
+
+void package_shard::start() {
+    assert(!_thread.joinable());
+    _stop = false;
+    _thread = std::thread(&package_shard::run, this);
+}
+
+void package_shard::stop() {
+    if (!_thread.joinable())
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stop = true;
+    }
+    _cond.notify_one();
+    _thread.join();
+}
+
+void package_shard::post(package_command* command) {
+    _queue.push(command);
+    // 与 run 中 "_sleeping = true 后再检查队列" 配对，保证不会漏掉唤醒
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (_sleeping.load(std::memory_order_seq_cst)) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _cond.notify_one();
+    }
+}
+
+void package_shard::run() {
+    static constexpr uint32_t spin_max = 64;
+
+    uint32_t idle = 0;
+    for (;;) {
+        auto node = _queue.pop();
+        if (node != nullptr) {
+            auto command = static_cast<package_command*>(node);
+            try {
+                command->execute(find(command->_uuid));
+            }
+            catch (...) {
+                // 一个命令失败不能结束分片线程
+                _failed.fetch_add(1, std::memory_order_relaxed);
+            }
+            delete command;
+            _executed.fetch_add(1, std::memory_order_relaxed);
+            idle = 0;
+            continue;
+        }
+
+        if (++idle < spin_max) {
+            std::this_thread::yield();
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(_mutex);
+        _sleeping.store(true, std::memory_order_seq_cst);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (_queue.empty()) {
+            if (_stop)
+                break;
+            _cond.wait(lock);
+        }
+        _sleeping.store(false, std::memory_order_relaxed);
+        idle = 0;
+    }
+    _sleeping.store(false, std::memory_order_relaxed);
+}
+
+object* package_shard::find(uint64_t uuid) {
+    auto iter = _objects.find(uuid);
+    return iter != _objects.end() ? iter->second.get() : nullptr;
+}
+
+package_service::package_service(uint32_t shard_count) {
+    assert(shard_count > 0);
+
+    _shards.reserve(shard_count);
+    for (uint32_t i = 0; i < shard_count; ++i) {
+        _shards.emplace_back(new package_shard());
+        _shards.back()->start();
+    }
+}
+
+package_service::~package_service() {
+    for (auto& shard : _shards) {
+        shard->stop();
+    }
+    _shards.clear();
+}
+
+std::future<bool> package_service::add_object(uint64_t uuid) {
+    auto shard = _shards[shard_of(uuid)].get();
+    return post(uuid, [shard, uuid](object* pObject) -> bool {
+        if (pObject != nullptr)
+            return false;
+        shard->_objects.emplace(uuid, std::unique_ptr<object>(new object(uuid)));
+        return true;
+    });
+}
+
+std::future<bool> package_service::remove_object(uint64_t uuid) {
+    auto shard = _shards[shard_of(uuid)].get();
+    return post(uuid, [shard, uuid](object* pObject) -> bool {
+        return pObject != nullptr && shard->_objects.erase(uuid) == 1;
+    });
+}
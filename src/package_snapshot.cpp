@@ -0,0 +1,177 @@
+#include "package_snapshot.h"
+
+#include <algorithm>
+#include <cassert>
+#include <vector>
+
+#include "binary_stream.h"
+#include "flat_hash_map.h"
+#include "goods.h"
+
+void package_snapshot::save(const package* package, binary_writer& out) {
+    assert(package);
+
+    static thread_local flat_hash_map<uint32_t, uint32_t> goods_index;
+    static thread_local std::vector<const goods*> goods_table;
+    goods_index.clear();
+    goods_table.clear();
+
+    // 末尾的空格子不写
+    slot_id slot_end = package->_capacity_max;
+    while (slot_end > 0 && package->_slot_count[slot_end - 1] == 0)
+        --slot_end;
+
+    uint32_t run_count = 0;
+    for (slot_id slot = 0; slot < slot_end; ++slot) {
+        if (slot == 0 || (package->_slot_count[slot] == 0) != (package->_slot_count[slot - 1] == 0))
+            ++run_count;
+        if (package->_slot_count[slot] != 0) {
+            const auto& pGoods = package->_slot_array[slot]._goods;
+            if (goods_index.emplace(pGoods->id(), static_cast<uint32_t>(goods_table.size())).second)
+                goods_table.emplace_back(pGoods.get());
+        }
+    }
+
+    out.write_u8(version);
+    out.write_varint(static_cast<uint32_t>(package->_type));
+    out.write_varint(package->_capacity_max);
+    out.write_varint(package->_capacity_cur);
+    out.write_varint(package->_journal_seq);
+
+    out.write_varint(goods_table.size());
+    for (const auto* pGoods : goods_table) {
+        out.write_varint(pGoods->id());
+        out.write_varint(static_cast<uint32_t>(pGoods->type()));
+        out.write_varint(pGoods->overlap_max());
+    }
+
+    out.write_varint(run_count);
+    slot_id slot = 0;
+    while (slot < slot_end) {
+        const bool occupied = package->_slot_count[slot] != 0;
+        slot_id run_end = slot + 1;
+        while (run_end < slot_end && (package->_slot_count[run_end] != 0) == occupied)
+            ++run_end;
+
+        out.write_varint((static_cast<uint64_t>(run_end - slot) << 1) | (occupied ? 1 : 0));
+        if (occupied) {
+            for (slot_id one = slot; one < run_end; ++one) {
+                const auto& slot_ref = package->_slot_array[one];
+                out.write_varint(goods_index.find(slot_ref._goods->id())->second);
+                out.write_varint(slot_ref._count);
+                if (slot_ref._goods->has_instance_state())
+                    out.write_varint(slot_ref._goods->uuid());
+            }
+        }
+        slot = run_end;
+    }
+}
+
+bool package_snapshot::load(const void* data, size_t size, package* package) {
+    assert(package && !package->_operator_mark);
+
+    struct goods_config {
+        uint32_t _id = 0;
+        uint32_t _type = 0;
+        uint32_t _overlap_max = 0;
+    };
+    struct slot_image {
+        slot_id  _slot = 0;
+        uint32_t _goods_index = 0;
+        uint32_t _count = 0;
+        uint64_t _uuid = 0;
+    };
+    static thread_local std::vector<goods_config> goods_table;
+    static thread_local std::vector<slot_image> slots;
+    goods_table.clear();
+    slots.clear();
+
+    // 先完整解析校验，再写入背包
+    binary_reader reader(data, size);
+    uint8_t ver = 0;
+    uint32_t type = 0, capacity_max = 0, capacity_cur = 0, goods_count = 0, run_count = 0;
+    uint64_t journal_seq = 0;
+    if (!reader.read_u8(ver) || ver != version)
+        return false;
+    if (!reader.read_varint(type) || !reader.read_varint(capacity_max)
+        || !reader.read_varint(capacity_cur) || !reader.read_varint(journal_seq))
+        return false;
+    if (type != static_cast<uint32_t>(package->_type) || capacity_max > package->_capacity_max || capacity_cur > capacity_max)
+        return false;
+
+    if (!reader.read_varint(goods_count) || goods_count > capacity_max)
+        return false;
+    goods_table.resize(goods_count);
+    for (auto& one : goods_table) {
+        reader.read_varint(one._id);
+        reader.read_varint(one._type);
+        reader.read_varint(one._overlap_max);
+    }
+
+    if (!reader.read_varint(run_count) || run_count > capacity_max)
+        return false;
+    slot_id slot = 0;
+    for (uint32_t run = 0; run < run_count && reader.ok(); ++run) {
+        uint64_t head = 0;
+        if (!reader.read_varint(head))
+            return false;
+        const uint64_t length = head >> 1;
+        if (length == 0 || length > capacity_max - slot)
+            return false;
+        if ((head & 1) == 0) {
+            slot += static_cast<slot_id>(length);
+            continue;
+        }
+        for (uint64_t i = 0; i < length; ++i) {
+            slot_image image;
+            image._slot = slot++;
+            reader.read_varint(image._goods_index);
+            reader.read_varint(image._count);
+            if (!reader.ok() || image._goods_index >= goods_count || image._count == 0)
+                return false;
+            if (static_cast<goods_type_enum>(goods_table[image._goods_index]._type) != goods_type_enum::item)
+                reader.read_varint(image._uuid);
+            slots.emplace_back(image);
+        }
+    }
+    if (!reader.ok())
+        return false;
+
+    // 物品配置只向注册表查一次
+    static thread_local std::vector<goods_ptr> goods_shared;
+    goods_shared.assign(goods_count, nullptr);
+    for (uint32_t i = 0; i < goods_count; ++i) {
+        const auto& config = goods_table[i];
+        if (static_cast<goods_type_enum>(config._type) == goods_type_enum::item)
+            goods_shared[i] = goods_registry::instance().intern(config._id, goods_type_enum::item, config._overlap_max);
+    }
+
+    for (auto& slot_ref : package->_slot_array) {
+        slot_ref.to_empty();
+    }
+    for (const auto& image : slots) {
+        auto& slot_ref = package->_slot_array[image._slot];
+        const auto& config = goods_table[image._goods_index];
+        if (goods_shared[image._goods_index])
+            slot_ref._goods = goods_shared[image._goods_index];
+        else
+            slot_ref._goods = goods::create(image._uuid, config._id, static_cast<goods_type_enum>(config._type), config._overlap_max);
+        slot_ref._count = image._count;
+    }
+    goods_shared.clear();
+
+    package->_goods_slot.reserve(goods_count);
+    package->_goods_partial.reserve(goods_count);
+    package->_goods_count.reserve(goods_count);
+    package->_capacity_cur = capacity_cur;
+    package->_journal_seq = journal_seq;
+
+    // 加载的内容就是已保存的内容
+    std::fill(package->_dirty_bits.begin(), package->_dirty_bits.end(), 0);
+    package->_dirty_count = 0;
+    package->_dirty_capacity = false;
+    package->_version.fetch_add(1, std::memory_order_release);
+    if (package->_view_enabled)
+        package->publish_view(nullptr);
+    return package->re_init();
+}
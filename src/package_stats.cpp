@@ -0,0 +1,138 @@
+#include "package_stats.h"
+
+#include <algorithm>
+#include <mutex>
+#include <sstream>
+#include <vector>
+
+namespace {
+
+    struct stats_registry {
+        std::mutex _mutex;
+        std::vector<const package_stats::thread_block*> _blocks;    // 运行中的线程
+        package_stats_snapshot _retired;                            // 已退出线程的合计
+    };
+
+    stats_registry& registry() {
+        static stats_registry* result = new stats_registry();       // 不析构：线程退出可能晚于静态对象析构
+        return *result;
+    }
+
+    void accumulate(package_stats_snapshot& result, const package_stats::thread_block& block) {
+        for (uint32_t i = 0; i < package_stats_snapshot::counter_count; ++i) {
+            result._counters[i] += block._counters[i].load(std::memory_order_relaxed);
+        }
+        for (uint32_t i = 0; i < package_stats_snapshot::histogram_count; ++i) {
+            for (uint32_t j = 0; j < package_stats_snapshot::bucket_count; ++j) {
+                result._buckets[i][j] += block._buckets[i][j].load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    const char* const counter_names[] = {
+        "find_calls",
+        "find_start_hit",
+        "empty_scans",
+        "empty_scan_words",
+        "partial_hit",
+        "partial_miss",
+        "rem_slot_copy",
+        "commits",
+        "rollbacks",
+        "mark_conflicts",
+        "version_conflicts",
+        "replays",
+        "notify_failures",
+    };
+    static_assert(sizeof(counter_names) / sizeof(counter_names[0]) == package_stats_snapshot::counter_count, "counter names");
+
+    const char* const histogram_names[] = {
+        "put_ns",
+        "rem_ns",
+        "swp_ns",
+        "aug_ns",
+        "move_ns",
+        "auto_pack_ns",
+        "commit_ns",
+        "rollback_ns",
+        "backup_slots",
+        "backup_goods_slot",
+    };
+    static_assert(sizeof(histogram_names) / sizeof(histogram_names[0]) == package_stats_snapshot::histogram_count, "histogram names");
+
+} // end namespace
+
+package_stats::thread_holder::thread_holder() {
+    auto& stats = registry();
+    std::lock_guard<std::mutex> lock(stats._mutex);
+    stats._blocks.emplace_back(&_block);
+}
+
+package_stats::thread_holder::~thread_holder() {
+    auto& stats = registry();
+    std::lock_guard<std::mutex> lock(stats._mutex);
+    accumulate(stats._retired, _block);
+    stats._blocks.erase(std::remove(stats._blocks.begin(), stats._blocks.end(), &_block), stats._blocks.end());
+}
+
+package_stats::thread_block* package_stats::register_thread() {
+    static thread_local thread_holder holder;
+    return &holder._block;
+}
+
+package_stats_snapshot package_stats::collect() {
+    auto& stats = registry();
+    std::lock_guard<std::mutex> lock(stats._mutex);
+    package_stats_snapshot result = stats._retired;
+    for (const auto* block : stats._blocks) {
+        accumulate(result, *block);
+    }
+    return result;
+}
+
+uint64_t package_stats_snapshot::count(stats_histogram name) const {
+    uint64_t result = 0;
+    for (auto value : _buckets[static_cast<uint32_t>(name)]) {
+        result += value;
+    }
+    return result;
+}
+
+uint64_t package_stats_snapshot::percentile(stats_histogram name, double p) const {
+    const uint64_t total = count(name);
+    if (total == 0)
+        return 0;
+
+    const auto& buckets = _buckets[static_cast<uint32_t>(name)];
+    const uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(p * total + 0.5));
+    uint64_t seen = 0;
+    for (uint32_t i = 0; i < bucket_count; ++i) {
+        seen += buckets[i];
+        if (seen >= rank)
+            return i == 0 ? 0 : (i >= 64 ? UINT64_MAX : (1ull << i) - 1);
+    }
+    return UINT64_MAX;
+}
+
+std::string package_stats_snapshot::to_string() const {
+    std::stringstream ss;
+    for (uint32_t i = 0; i < counter_count; ++i) {
+        ss << "package_" << counter_names[i] << " " << _counters[i] << "\n";
+    }
+    for (uint32_t i = 0; i < histogram_count; ++i) {
+        const auto name_ = static_cast<stats_histogram>(i);
+        ss << "package_" << histogram_names[i] << "_count " << count(name_) << "\n";
+        ss << "package_" << histogram_names[i] << "_p50 " << percentile(name_, 0.50) << "\n";
+        ss << "package_" << histogram_names[i] << "_p99 " << percentile(name_, 0.99) << "\n";
+        ss << "package_" << histogram_names[i] << "_max " << percentile(name_, 1.0) << "\n";
+    }
+    return ss.str();
+}
+
+const char* package_stats_snapshot::name(stats_counter name) {
+    return counter_names[static_cast<uint32_t>(name)];
+}
+
+const char* package_stats_snapshot::name(stats_histogram name) {
+    return histogram_names[static_cast<uint32_t>(name)];
+}
@@ -0,0 +1,90 @@
+#include "package_transaction.h"
+
+#include <cassert>
+
+package_transaction::package_transaction(object* owner) : _owner(owner) {
+}
+
+package_transaction::~package_transaction() {
+    release();
+}
+
+package_operator& package_transaction::operator_of(package_ptr package) {
+    assert(package && package->owner() == _owner);
+
+    for (auto& one : _operators) {
+        if (one->_package == package)
+            return *one;
+    }
+    _operators.emplace_back(std::make_unique<package_operator>(package));
+    return *_operators.back();
+}
+
+uint32_t package_transaction::move(package_ptr src, slot_id src_slot, package_ptr dst, slot_id dst_slot, uint32_t count) {
+    if (src == dst)
+        return 0;
+
+    auto& src_operator = operator_of(src);
+    auto& dst_operator = operator_of(dst);
+    return src_operator.move_to(dst_operator, src_slot, dst_slot, count);
+}
+
+package_transaction& package_transaction::commit() {
+    // 全部提交或全部不提交，不能只转移一半
+    if (conflicted()) {
+        rollback();
+        return *this;
+    }
+
+    for (auto& one : _operators) {
+        one->commit();
+    }
+    return *this;
+}
+
+package_operator::commit_result package_transaction::try_commit() {
+    bool conflict = false;
+    for (const auto& one : _operators) {
+        if (one->conflicted() || one->_package->version() != one->_base_version) {
+            conflict = true;
+            break;
+        }
+    }
+
+    if (conflict) {
+        for (auto& one : _operators) {
+            if (one->conflicted())
+                continue;
+            one->rollback();
+            one->backup_begin();
+        }
+        return package_operator::commit_result::conflict;
+    }
+
+    for (auto& one : _operators) {
+        one->commit();
+    }
+    return package_operator::commit_result::ok;
+}
+
+bool package_transaction::conflicted() const {
+    for (const auto& one : _operators) {
+        if (one->conflicted())
+            return true;
+    }
+    return false;
+}
+
+package_transaction& package_transaction::rollback() {
+    for (auto& one : _operators) {
+        one->rollback();
+    }
+    return *this;
+}
+
+void package_transaction::release() {
+    for (auto& one : _operators) {
+        one->release();
+    }
+    _operators.clear();
+}
@@ -0,0 +1,13 @@
+#include "package_view.h"
+
+#include "goods.h"
+
+uint64_t package_view::count_of(uint32_t goods_id) const {
+    uint64_t result = 0;
+    for (slot_id one = 0; one < _capacity_cur; ++one) {
+        const auto* slot = get_slot(one);
+        if (slot->_goods && slot->_goods->id() == goods_id)
+            result += slot->_count;
+    }
+    return result;
+}